@@ -15,7 +15,9 @@
 // 
 // The implementation uses three state flags internally:
 // * B_BUSY: the block has been returned from bread
-//     and has not been passed back to brelse.  
+//     and has not been passed back to brelse. Processes
+//     wanting a busy buffer wait in line on its wq, and
+//     brelse hands it to the first of them still busy.
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
@@ -23,7 +25,10 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 
@@ -72,10 +77,19 @@ bget(uint dev, uint blockno)
     if(b->dev == dev && b->blockno == blockno){
       if(!(b->flags & B_BUSY)){
         b->flags |= B_BUSY;
+        b->owner = proc;
         release(&bcache.lock);
+        holdlock();
+        return b;
+      }
+      // Busy the whole time it is handed over, so it can't
+      // have been recycled for another block when we get it.
+      lendprio(b->owner);
+      if(wqsleep(&b->wq, &bcache.lock)){
+        release(&bcache.lock);
+        holdlock();
         return b;
       }
-      sleep(b, &bcache.lock);
       goto loop;
     }
   }
@@ -88,7 +102,9 @@ bget(uint dev, uint blockno)
       b->dev = dev;
       b->blockno = blockno;
       b->flags = B_BUSY;
+      b->owner = proc;
       release(&bcache.lock);
+      holdlock();
       return b;
     }
   }
@@ -135,10 +151,12 @@ brelse(struct buf *b)
   bcache.head.next->prev = b;
   bcache.head.next = b;
 
-  b->flags &= ~B_BUSY;
-  wakeup(b);
+  // Pass it on to the next in line, or let it go.
+  if((b->owner = wqwake(&b->wq)) == 0)
+    b->flags &= ~B_BUSY;
 
   release(&bcache.lock);
+  droplock();
 }
 //PAGEBREAK!
 // Blank page.
@@ -5,6 +5,8 @@ struct buf {
   struct buf *prev; // LRU cache list
   struct buf *next;
   struct buf *qnext; // disk queue
+  struct waitq wq;   // processes waiting for B_BUSY to clear
+  struct proc *owner; // process that has it B_BUSY
   uchar data[BSIZE];
 };
 #define B_BUSY  0x1  // buffer is locked by some process
@@ -6,3 +6,8 @@ struct rtcdate {
   uint month;
   uint year;
 };
+
+struct timeval {
+  uint sec;
+  uint usec;
+};
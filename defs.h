@@ -4,11 +4,19 @@ struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct proclist;
 struct rtcdate;
 struct spinlock;
 struct stat;
 struct superblock;
+struct timeval;
+struct traceevent;
 struct uproc;
+struct procsnap;
+struct mlfqstat;
+struct lockstat;
+struct sleeplock;
+struct waitq;
 enum procstate;
 
 // bio.c
@@ -79,6 +87,9 @@ int             cpunum(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(uchar, int);
+void            lapiconeshot(uint);
+int             lapicperiodic(void);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -107,33 +118,60 @@ int             pipewrite(struct pipe*, char*, int);
 //PAGEBREAK: 16
 // proc.c
 struct proc*    copyproc(struct proc*);
-void            exit(void);
+void            droplock(void);
+void            exit(int);
 int             fork(void);
 int 			freedump(void);
+int 			getaffinity(int pid);
 int 			getuproc(uint, struct uproc*);
 int             growproc(int);
+int 			handoff(struct proc*, int pid);
+void            holdlock(void);
+int 			isolcpus(uint mask);
 int             kill(int);
+void            lendprio(struct proc*);
 void            pinit(void);
 void            procdump(void);
+int 			procsnap(int*, struct procsnap*, int);
 int 			runnabledump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int 			setaffinity(int pid, uint mask);
+void 			setname(struct proc*, char*);
+int 			mlfqstat(struct mlfqstat*);
+int 			lockstat(struct lockstat*, int);
+int 			setboost(int);
+int 			setpolicy(int);
+int 			setquantum(int, int, int);
+int 			sliceover(void);
 int 			setprio(int pid, int prio);
+int 			setrealtime(int pid, uint period, uint runtime);
+int 			settickets(int pid, int tickets);
+int 			tracedrain(struct traceevent*, int);
 void            sleep(void*, struct spinlock*);
 int 			sleepdump(void);
 void            userinit(void);
 int             wait(void);
+int             waitpid(int, int*, int);
 void            wakeup(void*);
+int             wqsleep(struct waitq*, struct spinlock*);
+struct proc*    wqwake(struct waitq*);
 void            yield(void);
+int 			yieldto(int pid);
 int				zombiedump(void);
 
-struct proc *	removefromhead(struct proc **, enum procstate);
-void 			addtohead(struct proc *, struct proc **, enum procstate);
-void 			remove(struct proc *, struct proc **, enum procstate);
-void			addtotail(struct proc *, struct proc **, enum procstate);
-void			promoterunnable(void);	
+struct proc *	removefromhead(struct proclist *, enum procstate);
+void 			addtohead(struct proc *, struct proclist *, enum procstate);
+void 			remove(struct proc *, struct proclist *, enum procstate);
+void			addtotail(struct proc *, struct proclist *, enum procstate);
 // swtch.S
 void            swtch(struct context**, struct context*);
+// sleeplock.c
+void            acquiresleep(struct sleeplock*);
+void            releasesleep(struct sleeplock*);
+int             holdingsleep(struct sleeplock*);
+void            initsleeplock(struct sleeplock*, char*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -162,6 +200,11 @@ void            syscall(void);
 
 // timer.c
 void            timerinit(void);
+void            tscinit(void);
+uint64          tsc2us(uint64);
+uint64          us2tsc(uint);
+void            uptimeus(struct timeval*);
+void            tsctime(uint64, struct timeval*);
 
 // trap.c
 void            idtinit(void);
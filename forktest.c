@@ -1,5 +1,6 @@
-// Test that fork fails gracefully.
-// Tiny executable so that the limit can be filling the proc table.
+// Test that fork fails gracefully, or keeps working for N children.
+// Tiny executable so that the limit is memory rather than its own size.
+// The proc table grows on demand, so reaching N is not an error.
 
 #include "types.h"
 #include "stat.h"
@@ -28,11 +29,6 @@ forktest(void)
       exit();
   }
   
-  if(n == N){
-    printf(1, "fork claimed to work N times!\n", N);
-    exit();
-  }
-  
   for(; n > 0; n--){
     if(wait() < 0){
       printf(1, "wait stopped early\n");
@@ -4,6 +4,7 @@
 
 #include "types.h"
 #include "defs.h"
+#include "param.h"
 #include "date.h"
 #include "memlayout.h"
 #include "traps.h"
@@ -32,6 +33,7 @@
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
   #define X1         0x0000000B   // divide counts by 1
   #define PERIODIC   0x00020000   // Periodic
+  #define ONESHOT    0x00000000   // One-shot
 #define PCINT   (0x0340/4)   // Performance Counter LVT
 #define LINT0   (0x0350/4)   // Local Vector Table 1 (LINT0)
 #define LINT1   (0x0360/4)   // Local Vector Table 2 (LINT1)
@@ -41,8 +43,13 @@
 #define TCCR    (0x0390/4)   // Timer Current Count
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
+#define TICKCOUNT  10000000       // Timer counts per tick
+#define MAXONESHOT 400            // Most ticks TICR can hold at once
+
 volatile uint *lapic;  // Initialized in mp.c
 
+static int oneshot[NCPU];  // Timer stopped by lapiconeshot()
+
 static void
 lapicw(int index, int value)
 {
@@ -66,7 +73,7 @@ lapicinit(void)
   // TICR would be calibrated using an external time source.
   lapicw(TDCR, X1);
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000); 
+  lapicw(TICR, TICKCOUNT); 
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -125,6 +132,52 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Stop this CPU's periodic tick and arm a single timer interrupt
+// nticks ticks from now, so an idle CPU isn't woken every tick
+// just to find nothing to do.  Interrupts must be off.
+void
+lapiconeshot(uint nticks)
+{
+  if(!lapic || nticks < 2)
+    return;
+  if(nticks > MAXONESHOT)
+    nticks = MAXONESHOT;
+  lapicw(TIMER, ONESHOT | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, nticks * TICKCOUNT);
+  oneshot[cpunum()] = 1;
+}
+
+// Undo lapiconeshot() and restart the periodic tick.
+// Returns 1 if the tick had been stopped.  Interrupts must be off.
+int
+lapicperiodic(void)
+{
+  int id;
+
+  if(!lapic)
+    return 0;
+  id = cpunum();
+  if(!oneshot[id])
+    return 0;
+  oneshot[id] = 0;
+  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, TICKCOUNT);
+  return 1;
+}
+
+// Send interrupt vector to the CPU with local APIC id apicid.
+// Interrupts must be off.
+void
+lapicipi(uchar apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -2,6 +2,7 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 
@@ -18,6 +19,9 @@
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
+// Waiting ops queue in order on log.wq. Whoever makes room
+// lets them in oldest first, counting each as outstanding
+// before waking it, so no newcomer can take its place.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -41,6 +45,7 @@ struct log {
   int size;
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  struct waitq wq; // begin_op() calls waiting to start, oldest first
   int dev;
   struct logheader lh;
 };
@@ -48,6 +53,8 @@ struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static int roomforop(void);
+static void admit(void);
 
 void
 initlog(int dev)
@@ -125,17 +132,39 @@ void
 begin_op(void)
 {
   acquire(&log.lock);
-  while(1){
-    if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
-    } else {
-      log.outstanding += 1;
-      release(&log.lock);
-      break;
+  // Get in line behind anyone already waiting, so a stream of
+  // new ops can't starve them. admit() counts us in before it
+  // wakes us. Woken some other way, we are out of line: go in
+  // if that is fair, else back in line.
+  if(log.wq.head || !roomforop()){
+    while(!wqsleep(&log.wq, &log.lock)){
+      if(!log.wq.head && roomforop()){
+        log.outstanding += 1;
+        break;
+      }
     }
+  } else
+    log.outstanding += 1;
+  release(&log.lock);
+}
+
+// Can one more op start now? Not while committing, and not if
+// it might exhaust log space. Called with log.lock held.
+static int
+roomforop(void)
+{
+  return !log.committing &&
+    log.lh.n + (log.outstanding+1)*MAXOPBLOCKS <= LOGSIZE;
+}
+
+// Let waiting ops in, oldest first, while there is room.
+// Each is counted in log.outstanding before it is woken.
+static void
+admit(void)
+{
+  while(log.wq.head && roomforop()){
+    log.outstanding += 1;
+    wqwake(&log.wq);
   }
 }
 
@@ -155,7 +184,7 @@ end_op(void)
     log.committing = 1;
   } else {
     // begin_op() may be waiting for log space.
-    wakeup(&log);
+    admit();
   }
   release(&log.lock);
 
@@ -165,7 +194,7 @@ end_op(void)
     commit();
     acquire(&log.lock);
     log.committing = 0;
-    wakeup(&log);
+    admit();
     release(&log.lock);
   }
 }
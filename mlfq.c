@@ -0,0 +1,48 @@
+// Show or tune the MLFQ.
+//   mlfq                              print the tunables and what each
+//                                     priority has done since boot
+//   mlfq boost ticks                  boost every ticks
+//   mlfq prio quantum budget          set a priority's time slice and
+//                                     its budget before demotion, in ticks
+//
+// Counters only grow, so run a workload between two "mlfq" and
+// subtract to see what it did.
+
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "uproc.h"
+
+static void
+show(void)
+{
+  struct mlfqstat st;
+  int i;
+
+  if(mlfqstat(&st) < 0){
+    printf(2, "mlfq: mlfqstat failed\n");
+    return;
+  }
+  printf(1, "boost every %d ticks\n", st.boost);
+  printf(1, "prio\tquantum\tbudget\truns\tdemoted\trun_ms\n");
+  for(i = 0; i < MAX; i++)
+    printf(1, "%d\t%d\t%d\t%d\t%d\t%d\n", i, st.level[i].quantum,
+      st.level[i].budget, st.level[i].dispatches, st.level[i].demotions,
+      st.level[i].runms);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc == 1)
+    show();
+  else if(argc == 3 && strcmp(argv[1], "boost") == 0){
+    if(setboost(atoi(argv[2])) < 0)
+      printf(2, "mlfq: bad boost interval %s\n", argv[2]);
+  } else if(argc == 4){
+    if(setquantum(atoi(argv[1]), atoi(argv[2]), atoi(argv[3])) < 0)
+      printf(2, "mlfq: bad priority, quantum or budget\n");
+  } else
+    printf(2, "usage: mlfq [boost ticks | prio quantum budget]\n");
+  exit();
+}
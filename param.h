@@ -1,4 +1,3 @@
-#define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
@@ -10,6 +9,9 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NSLEEPQSHIFT  6  // log2 of the number of sleep queues
+#define NSLEEPQ      (1 << NSLEEPQSHIFT)  // sleep channel hash buckets
+#define NPIDHASH    256  // PID index hash buckets
 // #define FSSIZE       1000  // size of file system in blocks
 #define FSSIZE       2000  // size of file system in blocks  // CS333 requires a larger FS.
 
@@ -18,5 +20,24 @@
 #define DEFAULT_GID  0
 #define DEFAULT_MODE 00755
 #define MAX 		 7
-#define TICKS_TO_PROMOTE 1000
-#define BUDGET		 200
+#define TICKS_TO_PROMOTE 1000  // boot value; see setboost()
+#define BUDGET		 200     // boot value at every priority; see setquantum()
+#define QUANTUM      1      // ticks in a priority 0 time slice; each level down doubles it
+#define USPERTICK    10000  // microseconds per tick (100 Hz)
+#define BUDGET_US    (BUDGET * USPERTICK)  // budget as charged by sched()
+#define IDLE_MAX_TICKS 10  // longest an idle CPU leaves its timer stopped
+#define ALLCPUS      ((1 << NCPU) - 1)  // default affinity
+#define NTRACE       256    // scheduler trace events kept per cpu, power of 2
+#define NLOCKSTAT    8      // entries lockstat() fills in
+#define ISOLCPUS     0      // cpus kept for pinned processes at boot, bit per cpu id
+#define RTUTIL       900    // permille of each cpu real-time reservations may take
+#define NKSTACKCACHE 8      // free kernel stacks kept per cpu for fork
+#define NPGDIRCACHE  2      // free page tables, kernel part still mapped, kept per cpu
+#define SCHED_MLFQ   0      // scheduling policies, for setpolicy()
+#define SCHED_STRIDE 1
+#define SCHED_RR     2
+#define NPOLICY      3
+#define SCHEDPOLICY  SCHED_MLFQ  // policy the kernel boots with
+#define STRIDE1      (1 << 20)   // stride of a process holding one ticket
+#define TICKETS      100    // tickets a new process starts with
+#define MAXTICKETS   10000  // most tickets settickets() will give
@@ -2,10 +2,11 @@
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "fs.h"
 #include "file.h"
-#include "spinlock.h"
 
 #define PIPESIZE 512
 
@@ -16,6 +17,12 @@ struct pipe {
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  struct proc *reader;  // Last process to read, for handoff()
+  struct proc *writer;  // Last process to write
+  int readerpid;
+  int writerpid;
+  int readerwaiting;  // Reader asleep on an empty pipe, or woken but not yet back
+  int writerwaiting;  // Writer likewise on a full pipe
 };
 
 int
@@ -33,6 +40,8 @@ pipealloc(struct file **f0, struct file **f1)
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
+  p->reader = p->writer = 0;
+  p->readerwaiting = p->writerwaiting = 0;
   initlock(&p->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -80,14 +89,22 @@ pipewrite(struct pipe *p, char *addr, int n)
   int i;
 
   acquire(&p->lock);
+  p->writer = proc;
+  p->writerpid = proc->pid;
   for(i = 0; i < n; i++){
     while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
       if(p->readopen == 0 || proc->killed){
         release(&p->lock);
         return -1;
       }
+      // Give our cpu straight to the reader we just woke, rather than
+      // leaving it queued behind other work, maybe on another cpu.
       wakeup(&p->nread);
+      if(p->reader && p->readerwaiting)
+        handoff(p->reader, p->readerpid);
+      p->writerwaiting = 1;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      p->writerwaiting = 0;
     }
     p->data[p->nwrite++ % PIPESIZE] = addr[i];
   }
@@ -102,12 +119,20 @@ piperead(struct pipe *p, char *addr, int n)
   int i;
 
   acquire(&p->lock);
+  p->reader = proc;
+  p->readerpid = proc->pid;
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
     if(proc->killed){
       release(&p->lock);
       return -1;
     }
+    // Only a writer we woke from a full pipe is owed our cpu; one
+    // that is merely runnable keeps its place in the queues.
+    if(p->writer && p->writerwaiting)
+      handoff(p->writer, p->writerpid);
+    p->readerwaiting = 1;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    p->readerwaiting = 0;
   }
   for(i = 0; i < n; i++){  //DOC: piperead-copy
     if(p->nread == p->nwrite)
@@ -0,0 +1,36 @@
+// Show or change the scheduling policy of the running system.
+//   policy           print the policy in force
+//   policy name      switch every cpu to rr, mlfq or stride
+//
+// To compare policies under the same load, switch and rerun:
+//   policy rr; schedbench; policy mlfq; schedbench
+
+#include "types.h"
+#include "user.h"
+#include "param.h"
+
+static char *names[] = {
+[SCHED_MLFQ]   "mlfq",
+[SCHED_STRIDE] "stride",
+[SCHED_RR]     "rr",
+};
+
+int
+main(int argc, char *argv[])
+{
+  int i, old;
+
+  if(argc < 2){
+    printf(1, "%s\n", names[setpolicy(-1)]);
+    exit();
+  }
+  for(i = 0; i < NPOLICY; i++)
+    if(strcmp(argv[1], names[i]) == 0)
+      break;
+  if(i == NPOLICY || (old = setpolicy(i)) < 0){
+    printf(2, "policy: %s not available\n", argv[1]);
+    exit();
+  }
+  printf(1, "%s -> %s\n", names[old], names[i]);
+  exit();
+}
@@ -4,45 +4,225 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
+#include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "uproc.h"
-#include "spinlock.h"
+#include "date.h"
+#include "trace.h"
+#include "wait.h"
+#include "traps.h"
 
 /** 
  * [Eli] Structure for keeping track of processes using linked lists 
  */
 struct StateLists {
-  struct proc* runnable[MAX];
-  struct proc* unused;
-  struct proc* sleep;
-  struct proc* zombie;
-  struct proc* running;
-  struct proc* embryo;
+  struct proclist unused;
+  struct proclist sleep[NSLEEPQ];  // hashed by sleep channel
+  struct proclist zombie;
+  struct proclist embryo;
+};
+
+// Locking. No one lock covers the whole table; fork, exit, wait,
+// sleep, wakeup and the schedulers on different cpus mostly take
+// different locks.
+//
+//   p->lock             p->state, chan, killed, prio, budget, epoch,
+//                       affinity, cpuid, tickets, stride and pass. Held across swtch(): the
+//                       process takes it before sched() and the
+//                       scheduler drops it once swtch() returns, and
+//                       the other way round when dispatching.
+//   c->rqlock           cpu c's run queues and their bookkeeping,
+//                       including c->pass and c->policy.
+//   ptable.sleeplock[i] sleep bucket i.
+//   ptable.waitlock     parent pointers, children and zombies lists,
+//                       and the zombie state list.
+//   ptable.freelock     unused and embryo lists, and adding slabs.
+//   ptable.pidlock      nextpid and the PID hash.
+//   ptable.rtlock       every cpu's rtutil.
+//   ptable.policylock   ptable.policy, and switching every cpu to it.
+//
+// The MLFQ tunables, boostticks, quantum[] and budget[], are single
+// words written with no lock; readers use whichever value they see.
+//
+// Order, outermost first:
+//
+//   sleep()'s lk (waitlock in wait()) -> sleeplock[i] -> p->lock
+//     -> c->rqlock, freelock, pidlock, rtlock
+//   ptable.policylock -> c->rqlock
+//
+// (kalloc()'s lock sits under freelock when a slab is added.)
+//
+// Only one p->lock is held at a time, and the last four are leaves.
+// A RUNNABLE process is always on the queue of cpus[p->cpuid] once
+// its p->lock is free. So to take a process off a queue the scheduler
+// finds it under rqlock, drops rqlock, takes p->lock and checks that
+// it is still there.
+// Procs are carved out of kalloc() pages, as many as fit in one.
+// Slabs are added when the unused list runs dry and are never
+// handed back, so a pointer to a proc always points at a proc;
+// findproc() and procsnap() depend on that to look without locks.
+#define NPROCSLAB ((PGSIZE - sizeof(void*)) / sizeof(struct proc))
+
+struct procslab {
+  struct procslab *next;           // Set once, before the slab is linked in
+  struct proc proc[NPROCSLAB];
 };
 
 struct {
-  struct spinlock lock;
-  struct proc proc[NPROC];
+  struct procslab *slabs;          // Append-only; readers need no lock
+  struct procslab **slabtail;      // Under freelock
+  uint nslab;                      // Under freelock
   struct StateLists pLists;
-  uint PromoteAtTime;
+  struct spinlock sleeplock[NSLEEPQ];
+  struct spinlock waitlock;
+  struct spinlock freelock;
+  struct spinlock pidlock;
+  struct spinlock rtlock;
+  struct spinlock policylock;
+  uint PromotedAt;                 // Tick of the last boost; only cpu 0
+                                   // writes this and epoch
+  uint boostticks;                 // Ticks between boosts; see setboost()
+  uint quantum[MAX];               // Ticks per time slice, by priority
+  int budget[MAX];                 // Microseconds before demotion, by priority
+  volatile uint epoch;             // Priority boosts so far; read it once per use
+  uint isolated;                   // Cpus left to processes pinned to them
+  int policy;                      // Index in policies[]; see setpolicy()
+  struct proc *pidhash[NPIDHASH];  // chained through proc.pidnext
 } ptable;
 
+// Each cpu records scheduler events in its own ring. Only that cpu
+// writes its ring, always with interrupts off, so recording takes no
+// lock. Readers check head again after copying an event to see
+// whether it was overwritten under them.
+struct tracerec {
+  uint64 tsc;
+  uint pid;
+  uint arg;
+  uchar type;
+  uchar prio;
+};
+
+static struct {
+  struct spinlock lock;      // Serializes readers only
+  struct {
+    volatile uint head;      // Events ever recorded here
+    uint tail;               // Next event to hand out; under lock
+    uint lost;               // Overwritten since the last drain; under lock
+    struct tracerec rec[NTRACE];
+  } ring[NCPU];
+} tracebuf;
+
 static struct proc *initproc;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+static void trace(int type, struct proc *p, uint arg);
+static struct proc *addslab(void);
+static struct proc *nextproc(struct proc *p);
+static void freeembryo(struct proc *p);
+static char *kstackalloc(void);
+static void kstackfree(char *s);
+static int reap(struct proc *p);
+static void pidinsert(struct proc *p);
+static void pidremove(struct proc *p);
+static struct proc *findproc(int pid);
+static struct proc *lockproc(int pid, int any);
+static struct proclist *runq(struct cpu *c, int prio);
+static void syncqueues(struct cpu *c);
+static int runprio(struct proc *p, uint epoch);
+static uint cpumask(struct proc *p);
+static uint rtshare(uint period, uint runtime);
+static void rtdrop(struct proc *p);
+static int rtmove(struct proc *p, uint mask);
+#ifdef CS333_P3P4
+static int effprio(struct proc *p, uint epoch);
+static void syncprio(struct proc *p, uint epoch);
+static int leastloaded(uint mask);
+static void enqueue(struct proc *p);
+static void dequeue(struct proc *p);
+static int sleephash(void *chan);
+static struct proc *nextrunnable(struct cpu *c);
+static void addchild(struct proc *p, struct childlist *l);
+static void removechild(struct proc *p, struct childlist *l);
+static void splicechildren(struct childlist *from, struct childlist *to);
+static struct cpu *busiestcpu(void);
+static struct proc *steal(struct cpu *c);
+static int claim(struct cpu *c, struct proc *p);
+static int outranked(struct proc *p);
+static uint idleticks(void);
+static void rtrefill(struct proc *p);
+static void rtenqueue(struct proc *p);
+static void kick(struct cpu *c, struct proc *p);
+static int preempts(struct proc *p, struct proc *cur);
+static void addbefore(struct proc *p, struct proc *next, struct proclist *q);
+static void rrenqueue(struct cpu *c, struct proc *p);
+static void rrdequeue(struct cpu *c, struct proc *p);
+static struct proc *rrnext(struct cpu *c, struct proc *p);
+static void mlfqenqueue(struct cpu *c, struct proc *p);
+static void mlfqdequeue(struct cpu *c, struct proc *p);
+static struct proc *mlfqnext(struct cpu *c, struct proc *p);
+static void mlfqtick(struct proc *p, uint us);
+static void mlfqboost(void);
+static int mlfqpreempts(struct proc *p, struct proc *cur);
+static uint mlfqslice(struct proc *p);
+static void strideenqueue(struct cpu *c, struct proc *p);
+static void stridedequeue(struct cpu *c, struct proc *p);
+static struct proc *stridenext(struct cpu *c, struct proc *p);
+static void stridetick(struct proc *p, uint us);
+static int stridepreempts(struct proc *p, struct proc *cur);
+
+// A scheduling policy keeps its own queues on every cpu and decides
+// the order queued work runs in. enqueue() and dequeue() look after
+// real-time work and choose the cpu, then hand over to that cpu's
+// policy. A process remembers in p->policy whose queues it went on,
+// so a switch on a live system can move it over later; see
+// setpolicy(). All but tick and slice are called with c->rqlock
+// held, tick from sched() with p->lock held, slice by the running
+// process itself. tick, boost, preempts and slice may be 0; with no
+// slice a process runs one tick at a time.
+struct policy {
+  char *name;
+  void (*enqueue)(struct cpu *c, struct proc *p);       // Queue p on c
+  void (*dequeue)(struct cpu *c, struct proc *p);       // Take queued p off c
+  struct proc *(*next)(struct cpu *c, struct proc *p);  // c's queue in run order; 0 starts
+  void (*tick)(struct proc *p, uint us);                // Charge p for us microseconds run
+  void (*boost)(void);                                  // Every boostticks, on cpu 0
+  int (*preempts)(struct proc *p, struct proc *cur);    // Should queued p displace cur?
+  uint (*slice)(struct proc *p);                        // Timer ticks p runs before yielding
+};
+
+static struct policy policies[NPOLICY] = {
+[SCHED_MLFQ]   { "mlfq", mlfqenqueue, mlfqdequeue, mlfqnext, mlfqtick, mlfqboost, mlfqpreempts, mlfqslice },
+[SCHED_STRIDE] { "stride", strideenqueue, stridedequeue, stridenext, stridetick, 0, stridepreempts },
+[SCHED_RR]     { "rr", rrenqueue, rrdequeue, rrnext, 0, 0, 0 },
+};
+#endif
 
 void
 pinit(void)
 {
-  initlock(&ptable.lock, "ptable");
+  struct cpu *c;
+  int i;
+
+  ptable.slabtail = &ptable.slabs;
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    initlock(&c->rqlock, "runq");
+  for(i = 0; i < NSLEEPQ; i++)
+    initlock(&ptable.sleeplock[i], "sleepq");
+  initlock(&ptable.waitlock, "wait");
+  initlock(&ptable.freelock, "freelist");
+  initlock(&ptable.pidlock, "pid");
+  initlock(&ptable.rtlock, "rt");
+  initlock(&ptable.policylock, "policy");
+  initlock(&tracebuf.lock, "trace");
 }
 
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
+// Look in the process table for an UNUSED proc,
+// adding a slab if there is none.
 // If found, change state to EMBRYO and initialize
 // state required to run in the kernel.
 // Otherwise return 0.
@@ -53,19 +233,23 @@ allocproc(void)
   char *sp;
 
   #ifndef CS333_P3P4
-  acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  acquire(&ptable.freelock);
+  for(p = nextproc(0); p; p = nextproc(p))
     if(p->state == UNUSED)
       goto found;
-  release(&ptable.lock);
+  if((p = addslab()) != 0)
+    goto found;
+  release(&ptable.freelock);
 
   // [Eli] Attempts to remove from head of unused list then uses goto to jump to state transition. Allowed use of goto.
   #else
-  acquire(&ptable.lock);
+  acquire(&ptable.freelock);
+  if(ptable.pLists.unused.head == 0)
+    addslab();
   if((p = removefromhead(&ptable.pLists.unused, UNUSED)) != 0)
     goto found;
 
-  release(&ptable.lock);
+  release(&ptable.freelock);
   #endif
   return 0;
 
@@ -75,26 +259,30 @@ found:
   #ifdef CS333_P3P4
   addtohead(p, &ptable.pLists.embryo, EMBRYO);
   #endif
+  release(&ptable.freelock);
 
+  acquire(&ptable.pidlock);
   p->pid = nextpid++;
+  pidinsert(p);
+  release(&ptable.pidlock);
+
   p->prio = 0;
-  p->budget = BUDGET;
-  release(&ptable.lock);
+  p->budget = ptable.budget[0];
+  p->inherit = MAX;
+  p->nlocks = 0;
+  p->epoch = ptable.epoch;
+  p->affinity = ALLCPUS;
+  p->rtperiod = 0;
+  p->onrtq = 0;
+  p->rtran = 0;
+  p->tickets = TICKETS;
+  p->stride = STRIDE1 / TICKETS;
+  p->pass = 0;
+  p->policy = ptable.policy;
 
   // Allocate kernel stack.
-  if((p->kstack = kalloc()) == 0){
-    acquire(&ptable.lock);
-
-    // [Eli] Put process back onto unused from embryo list if process can't allocate space.
-    #ifdef CS333_P3P4
-    remove(p, &ptable.pLists.embryo, EMBRYO);
-    p->state = UNUSED;
-    addtohead(p, &ptable.pLists.unused, UNUSED);
-    #else
-    p->state = UNUSED;
-    #endif
-
-    release(&ptable.lock);
+  if((p->kstack = kstackalloc()) == 0){
+    freeembryo(p);
     return 0;
   }
   
@@ -119,36 +307,150 @@ found:
   return p;
 }
 
-//PAGEBREAK: 32
-// Set up first user process.
-void
-userinit(void)
+/**
+ * Carves a new kalloc() page into UNUSED procs and links it onto the end of
+ * ptable.slabs. Called with freelock held. Returns the first new proc, or 0
+ * when memory is out.
+ */
+static struct proc *
+addslab(void)
 {
-  ptable.PromoteAtTime = ticks + TICKS_TO_PROMOTE;
+  struct procslab *s;
   struct proc *p;
-  extern char _binary_initcode_start[], _binary_initcode_size[];
 
-  acquire(&ptable.lock);
+  if((s = (struct procslab*)kalloc()) == 0)
+    return 0;
+  memset(s, 0, PGSIZE);
+  for(p = s->proc; p < &s->proc[NPROCSLAB]; p++) {
+    initlock(&p->lock, "proc");
+    p->state = UNUSED;
+    #ifdef CS333_P3P4
+    addtotail(p, &ptable.pLists.unused, UNUSED);
+    #endif
+  }
+
+  // Lockless walkers must see the slab filled in before they can reach it.
+  __sync_synchronize();
+  *ptable.slabtail = s;
+  ptable.slabtail = &s->next;
+  ptable.nslab++;
+  return s->proc;
+}
+
+/**
+ * Returns the proc slot after p, or the first one when p is 0, or 0 after the
+ * last. Covers every slot ever allocated, used or not, and takes no lock.
+ */
+static struct proc *
+nextproc(struct proc *p)
+{
+  struct procslab *s;
+
+  if(p == 0)
+    s = ptable.slabs;
+  else {
+    s = (struct procslab*)PGROUNDDOWN((uint)p);
+    if(++p < &s->proc[NPROCSLAB])
+      return p;
+    s = s->next;
+  }
+  return s ? s->proc : 0;
+}
+
+/**
+ * Returns a kernel stack, from this CPU's cache if it has one, else from kalloc().
+ * Cached stacks skip kalloc()'s global lock and kfree()'s junk fill.
+ */
+static char *
+kstackalloc(void)
+{
+  char *s = 0;
+
+  pushcli();
+  if(cpu->nkstacks > 0) {
+    s = cpu->kstacks[--cpu->nkstacks];
+    cpu->kstackhit++;
+  } else
+    cpu->kstackmiss++;
+  popcli();
+  if(s == 0)
+    s = kalloc();
+  return s;
+}
 
-  // [Eli] Initializes all the pointers to the heads of the linked lists
-  // and initializes all processes in process array to unused.
+/**
+ * Gives back a kernel stack, to this CPU's cache if it has room.
+ */
+static void
+kstackfree(char *s)
+{
+  pushcli();
+  if(cpu->nkstacks < NKSTACKCACHE) {
+    cpu->kstacks[cpu->nkstacks++] = s;
+    s = 0;
+  }
+  popcli();
+  if(s)
+    kfree(s);
+}
 
-  ptable.pLists.embryo = 0;
-  for(int i = 0; i < MAX; i++)
-    ptable.pLists.runnable[i] = 0;
-  ptable.pLists.sleep = 0;
-  ptable.pLists.zombie = 0;
-  ptable.pLists.running = 0;
+/**
+ * Gives back a process that allocproc() handed out but that never ran.
+ */
+static void
+freeembryo(struct proc *p)
+{
+  acquire(&ptable.pidlock);
+  pidremove(p);
+  release(&ptable.pidlock);
 
-  ptable.pLists.unused = ptable.proc;
+  // [Eli] Put process back onto unused from embryo list.
+  acquire(&ptable.freelock);
+  #ifdef CS333_P3P4
+  remove(p, &ptable.pLists.embryo, EMBRYO);
+  p->state = UNUSED;
+  addtohead(p, &ptable.pLists.unused, UNUSED);
+  #else
+  p->state = UNUSED;
+  #endif
+  release(&ptable.freelock);
+}
 
-  for(int i = 0; i < NPROC - 1; i++) {
-    ptable.proc[i].next = &ptable.proc[i + 1];
+//PAGEBREAK: 32
+// Set up first user process.
+void
+userinit(void)
+{
+  ptable.PromotedAt = ticks;
+  ptable.boostticks = TICKS_TO_PROMOTE;
+  for(int i = 0; i < MAX; i++) {
+    ptable.quantum[i] = QUANTUM << i;
+    ptable.budget[i] = BUDGET_US;
   }
+  ptable.isolated = ISOLCPUS;
+  ptable.policy = SCHEDPOLICY;
+  struct proc *p;
+  extern char _binary_initcode_start[], _binary_initcode_size[];
 
-  ptable.proc[NPROC - 1].next = 0;
+  acquire(&ptable.freelock);
+
+  // [Eli] Initializes all the pointers to the heads of the linked lists.
+  // The unused list fills a slab at a time as allocproc() needs procs.
+
+  memset(&ptable.pLists, 0, sizeof(ptable.pLists));
+  for(struct cpu *c = cpus; c < &cpus[NCPU]; c++) {
+    memset(c->runnable, 0, sizeof(c->runnable));
+    c->qbase = 0;
+    c->epoch = ptable.epoch;
+    c->rqmask = 0;
+    c->nrunnable = 0;
+    memset(&c->strideq, 0, sizeof(c->strideq));
+    c->pass = 0;
+    memset(&c->rrq, 0, sizeof(c->rrq));
+    c->policy = SCHEDPOLICY;
+  }
 
-  release(&ptable.lock);
+  release(&ptable.freelock);
   
   p = allocproc();
   initproc = p;
@@ -168,18 +470,21 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  acquire(&ptable.lock);
+  acquire(&p->lock);
 
   // [Eli] Add process to runnable from embryo list.
   #ifdef CS333_P3P4
+  acquire(&ptable.freelock);
   remove(p, &ptable.pLists.embryo, EMBRYO);
+  release(&ptable.freelock);
   p->state = RUNNABLE;
-  addtotail(p, &ptable.pLists.runnable[0], RUNNABLE);
+  p->cpuid = cpu->id;
+  enqueue(p);
   #else
   p->state = RUNNABLE;
   #endif
 
-  release(&ptable.lock);
+  release(&p->lock);
   p->gid = DEFAULT_GID;
   p->uid = DEFAULT_UID;
 }
@@ -219,29 +524,22 @@ fork(void)
 
   // Copy process state from p.
   if((np->pgdir = copyuvm(proc->pgdir, proc->sz)) == 0){
-    kfree(np->kstack);
+    kstackfree(np->kstack);
     np->kstack = 0;
-
-    acquire(&ptable.lock);
-
-    // [Eli] Add process to unused from embryo list.
-    #ifdef CS333_P3P4
-    remove(np, &ptable.pLists.embryo, EMBRYO);
-    np->state = UNUSED;
-    addtohead(np, &ptable.pLists.unused, UNUSED);
-    #else
-    np->state = UNUSED;
-    #endif
-
-    release(&ptable.lock);
-
+    freeembryo(np);
     return -1;
   }
   np->sz = proc->sz;
-  np->parent = proc;
   *np->tf = *proc->tf;
   np->uid = proc->uid;
   np->gid = proc->gid;
+  np->affinity = proc->affinity;
+
+  // The child starts where its parent's pass is, so forking
+  // can't be used to get a fresh lead over everyone else.
+  np->tickets = proc->tickets;
+  np->stride = proc->stride;
+  np->pass = proc->pass;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
@@ -256,35 +554,49 @@ fork(void)
   pid = np->pid;
 
 
+  acquire(&ptable.waitlock);
+  np->parent = proc;
+  #ifdef CS333_P3P4
+  addchild(np, &proc->children);
+  #endif
+  release(&ptable.waitlock);
+
   // lock to force the compiler to emit the np->state write last.
-  acquire(&ptable.lock);
+  acquire(&np->lock);
 
   // [Eli] Add process to runnable from embryo list.
   #ifdef CS333_P3P4
+  // The child starts on the least loaded CPU; stealing evens
+  // things out later if that guess goes stale.
+  acquire(&ptable.freelock);
   remove(np, &ptable.pLists.embryo, EMBRYO);
+  release(&ptable.freelock);
   np->state = RUNNABLE;
-  addtotail(np, &ptable.pLists.runnable[0], RUNNABLE);
+  np->cpuid = leastloaded(cpumask(np));
+  enqueue(np);
   #else
   np->state = RUNNABLE;
   #endif
+  trace(TR_FORK, np, proc->pid);
 
-  release(&ptable.lock);
+  release(&np->lock);
   
   return pid;
 }
 
-// Exit the current process.  Does not return.
+// Exit the current process with the given status.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
 #ifndef CS333_P3P4
 void
-exit(void)
+exit(int status)
 {
   struct proc *p;
   int fd;
 
   if(proc == initproc)
     panic("init exiting");
+  proc->xstatus = status;
 
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
@@ -299,22 +611,28 @@ exit(void)
   end_op();
   proc->cwd = 0;
 
-  acquire(&ptable.lock);
+  acquire(&ptable.waitlock);
 
   // Parent might be sleeping in wait().
-  wakeup1(proc->parent);
+  wakeup(proc->parent);
 
   // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = nextproc(0); p; p = nextproc(p)){
     if(p->parent == proc){
       p->parent = initproc;
       if(p->state == ZOMBIE)
-        wakeup1(initproc);
+        wakeup(initproc);
     }
   }
 
-  // Jump into the scheduler, never to return.
+  // Jump into the scheduler, never to return. The parent can't
+  // look at us until waitlock is free, and can't free us until
+  // the scheduler drops our lock.
+  acquire(&proc->lock);
+  rtdrop(proc);
   proc->state = ZOMBIE;
+  trace(TR_EXIT, proc, 0);
+  release(&ptable.waitlock);
   sched();
   panic("zombie exit");
 }
@@ -322,13 +640,14 @@ exit(void)
 #else
 
 void
-exit(void)
+exit(int status)
 {
   struct proc *p;
   int fd;
 
   if(proc == initproc)
     panic("init exiting");
+  proc->xstatus = status;
 
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
@@ -343,121 +662,183 @@ exit(void)
   end_op();
   proc->cwd = 0;
 
-  acquire(&ptable.lock);
+  acquire(&ptable.waitlock);
 
   // Parent might be sleeping in wait().
-  wakeup1(proc->parent);
-
-  // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == proc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
+  wakeup(proc->parent);
+
+  // Pass abandoned children to init. Only the parent pointers
+  // need touching one by one; the lists move over whole.
+  for(p = proc->children.head; p; p = p->sibnext)
+    p->parent = initproc;
+  for(p = proc->zombies.head; p; p = p->sibnext)
+    p->parent = initproc;
+  splicechildren(&proc->children, &initproc->children);
+  if(proc->zombies.head){
+    splicechildren(&proc->zombies, &initproc->zombies);
+    wakeup(initproc);
   }
 
-  // Jump into the scheduler, never to return.
+  // Let the parent's wait() find us without a scan.
+  removechild(proc, &proc->parent->children);
+  addchild(proc, &proc->parent->zombies);
 
-  // [Eli] Add process to zombie from running list.
-  remove(proc, &ptable.pLists.running, RUNNING);
+  // Jump into the scheduler, never to return. The parent can't
+  // look at us until waitlock is free, and can't free us until
+  // the scheduler drops our lock.
+
+  // [Eli] Add process to zombie list.
+  acquire(&proc->lock);
+  rtdrop(proc);
   proc->state = ZOMBIE;
   addtohead(proc, &ptable.pLists.zombie, ZOMBIE);
+  trace(TR_EXIT, proc, 0);
+  release(&ptable.waitlock);
 
   sched();
   panic("zombie exit");
 }
 #endif
 
+/**
+ * Frees a zombie child and returns its pid. Called with waitlock and p->lock held;
+ * holding p->lock means p has finished switching away for the last time.
+ */
+static int
+reap(struct proc *p)
+{
+  int pid;
+
+  pid = p->pid;
+  p->seq++;
+  kstackfree(p->kstack);
+  p->kstack = 0;
+  freevm(p->pgdir);
+
+  acquire(&ptable.pidlock);
+  pidremove(p);
+  release(&ptable.pidlock);
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+
+  // [Eli] Add process to unused from zombie list.
+  acquire(&ptable.freelock);
+  #ifdef CS333_P3P4
+  remove(p, &ptable.pLists.zombie, ZOMBIE);
+  p->state = UNUSED;
+  addtohead(p, &ptable.pLists.unused, UNUSED);
+  #else
+  p->state = UNUSED;
+  #endif
+  release(&ptable.freelock);
+  p->seq++;
+  return pid;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
-#ifndef CS333_P3P4
 int
 wait(void)
+{
+  return waitpid(-1, 0, 0);
+}
+
+// Wait for child pid, or any child if pid is -1, to exit, store
+// its exit status in *status unless status is 0, and return its
+// pid. With WNOHANG, return 0 instead of waiting when the child
+// is still running. Return -1 if there is no such child.
+#ifndef CS333_P3P4
+int
+waitpid(int pid, int *status, int options)
 {
   struct proc *p;
-  int havekids, pid;
+  int havekids, xpid;
 
-  acquire(&ptable.lock);
+  acquire(&ptable.waitlock);
   for(;;){
     // Scan through table looking for zombie children.
     havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != proc)
+    for(p = nextproc(0); p; p = nextproc(p)){
+      if(p->parent != proc || (pid > 0 && p->pid != pid))
         continue;
       havekids = 1;
+      acquire(&p->lock);
       if(p->state == ZOMBIE){
         // Found one.
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->state = UNUSED;
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        release(&ptable.lock);
-        return pid;
+        if(status)
+          *status = p->xstatus;
+        xpid = reap(p);
+        release(&p->lock);
+        release(&ptable.waitlock);
+        return xpid;
       }
+      release(&p->lock);
     }
 
     // No point waiting if we don't have any children.
     if(!havekids || proc->killed){
-      release(&ptable.lock);
+      release(&ptable.waitlock);
       return -1;
     }
+    if(options & WNOHANG){
+      release(&ptable.waitlock);
+      return 0;
+    }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(proc, &ptable.lock);  //DOC: wait-sleep
+    // Wait for children to exit.  (See wakeup call in proc_exit.)
+    sleep(proc, &ptable.waitlock);  //DOC: wait-sleep
   }
 }
 
 #else
 
 int
-wait(void)
+waitpid(int pid, int *status, int options)
 {
   struct proc *p;
-  int havekids, pid;
+  int xpid;
 
-  acquire(&ptable.lock);
+  acquire(&ptable.waitlock);
   for(;;){
-    // Scan through table looking for zombie children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != proc)
-        continue;
-      havekids = 1;
-      if(p->state == ZOMBIE){
-        // Found one.
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-
-        // [Eli] Add process to unused from zombie list.
-        remove(p, &ptable.pLists.zombie, ZOMBIE);
-        p->state = UNUSED;
-        addtohead(p, &ptable.pLists.unused, UNUSED);
-
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        release(&ptable.lock);
-        return pid;
+    // Exited children are waiting on our zombies list, and the PID
+    // index finds a particular child without looking through them.
+    // A child moves to the zombies list under waitlock, so being on
+    // it and being a ZOMBIE go together here.
+    if(pid > 0){
+      if((p = findproc(pid)) == 0 || p->parent != proc){
+        release(&ptable.waitlock);
+        return -1;
       }
+      if(p->state != ZOMBIE)
+        p = 0;
+    } else
+      p = proc->zombies.head;
+
+    if(p){
+      removechild(p, &proc->zombies);
+      acquire(&p->lock);
+      if(status)
+        *status = p->xstatus;
+      xpid = reap(p);
+      release(&p->lock);
+      release(&ptable.waitlock);
+      return xpid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || proc->killed){
-      release(&ptable.lock);
+    if(!proc->children.head || proc->killed){
+      release(&ptable.waitlock);
       return -1;
     }
+    if(options & WNOHANG){
+      release(&ptable.waitlock);
+      return 0;
+    }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(proc, &ptable.lock);  //DOC: wait-sleep
+    // Wait for children to exit.  (See wakeup call in proc_exit.)
+    sleep(proc, &ptable.waitlock);  //DOC: wait-sleep
   }
 }
 #endif
@@ -484,27 +865,31 @@ scheduler(void)
 
     idle = 1;  // assume idle unless we schedule a process
     // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
+    for(p = nextproc(0); p; p = nextproc(p)){
+      acquire(&p->lock);
+      if(p->state != RUNNABLE || (cpumask(p) & (1 << cpu->id)) == 0){
+        release(&p->lock);
         continue;
+      }
 
       // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
+      // to release p->lock and then reacquire it
       // before jumping back to us.
       idle = 0;  // not idle this timeslice
       proc = p;
       switchuvm(p);
       p->state = RUNNING;
-      p->cpu_ticks_in = ticks;
+      trace(TR_DISPATCH, p, cpu->id);
+      cpu->switches++;
+      p->cpu_cycles_in = rdtsc();
       swtch(&cpu->scheduler, proc->context);
       switchkvm();
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
       proc = 0;
+      release(&p->lock);
     }
-    release(&ptable.lock);
     // if idle, wait for next interrupt
     if (idle) {
       sti();
@@ -518,58 +903,104 @@ void
 scheduler(void)
 {
   struct proc *p;
-  int idle;  // for checking if processor is idle
+  struct cpu *c;
+  uint used;
 
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    idle = 1;  // assume idle unless we schedule a process
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-
-    if(ticks >= ptable.PromoteAtTime)
+    // cpu 0 keeps time, so it is the only one to run the policy's
+    // periodic boost.
+    if(cpu->id == 0 && ticks - ptable.PromotedAt >= ptable.boostticks)
     {
-      ptable.PromoteAtTime = ticks + TICKS_TO_PROMOTE;
-      promoterunnable();
+      ptable.PromotedAt = ticks;
+      if(policies[ptable.policy].boost)
+        policies[ptable.policy].boost();
     }
 
-    // [Eli] Attempt to remove from runnable, if able to, add process to running list.
-    for(int i = 0; i < MAX; i++) {
-      if((p = removefromhead(&ptable.pLists.runnable[i], RUNNABLE)) != 0)
-        break;
+    // Once a pass has found nothing, peek at the queue counts before
+    // locking anything again, so an idle CPU doesn't fight the busy
+    // ones for their run queue locks on every interrupt. A stale
+    // count only costs one more trip around. Clearing kicked before
+    // the look means anything queued after it brings an IPI, and
+    // with interrupts off until the hlt that IPI can't be missed.
+    cli();
+    if(cpu->idle) {
+      cpu->kicked = 0;
+      __sync_synchronize();
+      if(cpu->nrunnable == 0 && busiestcpu() == 0) {
+        stihlt();
+        continue;
+      }
+
+      // Back from idle: restart our tick before running anything.
+      cpu->idle = 0;
+      lapicperiodic();
     }
+    sti();
+
+    // A process that gave up this cpu to a partner gets it first,
+    // for what is left of the donor's slice, unless real-time work
+    // or something that outranks it is waiting. Then run our own work.
+    // With nothing queued here, steal the best process allowed here
+    // from whichever peer has the longest queues. Either way p comes
+    // back locked and off its queue.
+    p = cpu->handoff;
+    cpu->handoff = 0;
+    if(p && (cpu->nrt || outranked(p) || !claim(cpu, p)))
+      p = 0;
+    used = 0;
+    if(p)
+      used = cpu->handoffticks;
+    else if((p = nextrunnable(cpu)) == 0 && (c = busiestcpu()) != 0)
+      p = steal(c);
     if(p) {
 
       // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      idle = 0;  // not idle this timeslice
+      // to release p->lock and then reacquire it
+      // before jumping back to us. Whatever asked for a
+      // reschedule has had it.
+      cpu->needresched = 0;
       proc = p;
       switchuvm(p);
       p->state = RUNNING;
+      trace(TR_DISPATCH, p, p->cpuid);
+      cpu->switches++;
+      p->cpuid = cpu->id;
 
-      addtohead(p, &ptable.pLists.running, RUNNING);
-
-      p->cpu_ticks_in = ticks;
+      p->sliceticks = used;
+      p->cpu_cycles_in = rdtsc();
       swtch(&cpu->scheduler, proc->context);
       switchkvm();
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
       proc = 0;
-    }
-    release(&ptable.lock);
-    // if idle, wait for next interrupt
-    if (idle) {
-      sti();
-      hlt();
+      release(&p->lock);
+    } else {
+      // Nothing to run. Stop our tick until the next time anything
+      // could change: a sleeper coming due. cpu 0 keeps its tick since
+      // it is the one advancing ticks and starting boost epochs.
+      // Something queued here after our look is picked up now; anything
+      // queued later sees idle set and kicks us.
+      cli();
+      cpu->kicked = 0;
+      cpu->idle = 1;
+      __sync_synchronize();
+      if(cpu->nrunnable) {
+        cpu->idle = 0;
+        continue;
+      }
+      if(cpu->id != 0)
+        lapiconeshot(idleticks());
+      stihlt();
     }
   }
 }
 #endif
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only proc->lock
 // and have changed proc->state.
 #ifndef CS333_P3P4
 void
@@ -577,8 +1008,8 @@ sched(void)
 {
   int intena;
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&proc->lock))
+    panic("sched proc->lock");
   if(cpu->ncli != 1)
     panic("sched locks");
   if(proc->state == RUNNING)
@@ -586,7 +1017,7 @@ sched(void)
   if(readeflags()&FL_IF)
     panic("sched interruptible");
   intena = cpu->intena;
-  proc->cpu_ticks_total += ticks - proc->cpu_ticks_in;
+  proc->cpu_cycles_total += rdtsc() - proc->cpu_cycles_in;
   swtch(&proc->context, cpu->scheduler);
   cpu->intena = intena;
 }
@@ -598,8 +1029,9 @@ sched(void)
 {
 
   int intena;
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  uint64 used;
+  if(!holding(&proc->lock))
+    panic("sched proc->lock");
   if(cpu->ncli != 1)
     panic("sched locks");
   if(proc->state == RUNNING)
@@ -607,19 +1039,22 @@ sched(void)
   if(readeflags()&FL_IF)
     panic("sched interruptible");
   intena = cpu->intena;
-  proc->cpu_ticks_total += ticks - proc->cpu_ticks_in;
-  proc->budget = proc->budget - (ticks - proc->cpu_ticks_in);
-
-  if(proc->budget <= 0 && proc->prio != (MAX - 1)) {
-    if(proc->state == RUNNABLE) {
-      remove(proc, &ptable.pLists.runnable[proc->prio], RUNNABLE);
-      proc->prio++;
-      addtotail(proc, &ptable.pLists.runnable[proc->prio], RUNNABLE);
+
+  // Charge the exact run time, so a burst shorter than a tick
+  // still counts. Time run as real-time comes out of the period's
+  // run time; once that is used up the process drops back to its
+  // policy until its next period. Otherwise the policy that ran
+  // the process charges it.
+  used = rdtsc() - proc->cpu_cycles_in;
+  proc->cpu_cycles_total += used;
+  if(proc->rtran) {
+    proc->rtbudget -= tsc2us(used);
+    if(proc->rtbudget <= 0 && proc->state == RUNNABLE && proc->onrtq) {
+      dequeue(proc);
+      enqueue(proc);
     }
-    else
-      proc->prio++;
-    proc->budget = BUDGET;
-  }
+  } else if(policies[proc->policy].tick)
+    policies[proc->policy].tick(proc, tsc2us(used));
 
   swtch(&proc->context, cpu->scheduler);
   cpu->intena = intena;
@@ -630,19 +1065,37 @@ sched(void)
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
+  acquire(&proc->lock);  //DOC: yieldlock
   
-  // [Eli] Add process to runnable from running list.
-  #ifdef CS333_P3P4
-  remove(proc, &ptable.pLists.running, RUNNING);
-  proc->state = RUNNABLE;
-  addtotail(proc, &ptable.pLists.runnable[proc->prio], RUNNABLE);
-  #else
+  // [Eli] Add process to runnable.
   proc->state = RUNNABLE;
+  trace(TR_YIELD, proc, 0);
+  #ifdef CS333_P3P4
+  enqueue(proc);
   #endif
 
   sched();
-  release(&ptable.lock);
+  release(&proc->lock);
+}
+
+// Give up the CPU to process pid, which runs next here if it is
+// runnable, may use this CPU and isn't outranked by queued work.
+// Only our own processes and our children qualify. Returns -1 if
+// pid can't have the CPU.
+int
+yieldto(int pid)
+{
+  struct proc *p;
+  int ok;
+
+  if((p = lockproc(pid, 0)) == 0)
+    return -1;
+  ok = p != proc && (p->uid == proc->uid || p->parent == proc);
+  release(&p->lock);
+  if(!ok || handoff(p, pid) < 0)
+    return -1;
+  yield();
+  return 0;
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -651,8 +1104,8 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding proc->lock from scheduler.
+  release(&proc->lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -673,30 +1126,35 @@ forkret(void)
 void
 sleep(void *chan, struct spinlock *lk)
 {
+  #ifdef CS333_P3P4
+  int h;
+  #endif
+
   if(proc == 0)
     panic("sleep");
 
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if(lk != &ptable.lock){
-    acquire(&ptable.lock);
-    if (lk) release(lk);
-  }
+  // Must acquire proc->lock in order to
+  // change proc->state and then call sched.
+  // Once we hold proc->lock (and our sleep bucket's
+  // lock), we can be guaranteed that we won't miss
+  // any wakeup (wakeup takes both), so it's okay
+  // to release lk.
+  #ifdef CS333_P3P4
+  h = sleephash(chan);
+  acquire(&ptable.sleeplock[h]);
+  #endif
+  acquire(&proc->lock);
+  if (lk) release(lk);
 
   // Go to sleep.
   proc->chan = chan;
 
-  // [Eli] Add process to sleeping from running list.
-  #ifdef CS333_P3P4
-  remove(proc, &ptable.pLists.running, RUNNING);
-  proc->state = SLEEPING;
-  addtohead(proc, &ptable.pLists.sleep, SLEEPING);
-  #else
+  // [Eli] Add process to sleeping list.
   proc->state = SLEEPING;
+  trace(TR_SLEEP, proc, (uint)chan);
+  #ifdef CS333_P3P4
+  addtotail(proc, &ptable.pLists.sleep[h], SLEEPING);
+  release(&ptable.sleeplock[h]);
   #endif
 
   sched();
@@ -705,52 +1163,173 @@ sleep(void *chan, struct spinlock *lk)
   proc->chan = 0;
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){ 
-    release(&ptable.lock);
-    if (lk) acquire(lk);
-  }
+  release(&proc->lock);
+  if (lk) acquire(lk);
 }
 
 //PAGEBREAK!
 #ifndef CS333_P3P4
 // Wake up all processes sleeping on chan.
-// The ptable lock must be held.
-static void
-wakeup1(void *chan)
+// Must be called without any p->lock held.
+void
+wakeup(void *chan)
 {
   struct proc *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  for(p = nextproc(0); p; p = nextproc(p)) {
+    acquire(&p->lock);
     if(p->state == SLEEPING && p->chan == chan) {
       p->state = RUNNABLE;
+      trace(TR_WAKEUP, p, (uint)chan);
     }
+    release(&p->lock);
+  }
 }
 #else
-static void
-wakeup1(void *chan)
+void
+wakeup(void *chan)
+{
+  struct proclist *q;
+  struct proc *p, *next;
+  int h;
+
+  // Only the bucket chan hashes to can hold its sleepers.
+  h = sleephash(chan);
+  q = &ptable.pLists.sleep[h];
+  acquire(&ptable.sleeplock[h]);
+  for(p = q->head; p; p = next) {
+    next = p->next;
+    if(p->chan == chan) {
+
+      // [Eli] Add process to runnable from sleeping list. Waits for
+      // a sleeper still on its way out to finish switching away.
+      acquire(&p->lock);
+      remove(p, q, SLEEPING);
+      p->state = RUNNABLE;
+      trace(TR_WAKEUP, p, (uint)chan);
+      enqueue(p);
+      release(&p->lock);
+    }
+  }
+  release(&ptable.sleeplock[h]);
+}
+#endif
+
+// Wait at the end of q's line until wqwake() picks us. Called, and
+// returns, with lk held; lk must be what guards q. Each waiter sleeps
+// on a channel of its own, so a wakeup reaches it alone. Returns 1
+// when picked, or 0 when something else, such as kill(), woke us;
+// then we are out of line and the caller should look again.
+int
+wqsleep(struct waitq *q, struct spinlock *lk)
+{
+  struct proc *p, *prev;
+
+  proc->waitq = q;
+  proc->wqnext = 0;
+  if(q->tail)
+    q->tail->wqnext = proc;
+  else
+    q->head = proc;
+  q->tail = proc;
+
+  sleep(&proc->waitq, lk);
+  if(proc->waitq == 0)
+    return 1;
+
+  prev = 0;
+  for(p = q->head; p != proc; p = p->wqnext)
+    prev = p;
+  if(prev)
+    prev->wqnext = proc->wqnext;
+  else
+    q->head = proc->wqnext;
+  if(q->tail == proc)
+    q->tail = prev;
+  proc->waitq = 0;
+  return 0;
+}
+
+// Wake the process that has waited longest on q, if any, and return
+// it. Called with the lock that guards q held.
+struct proc*
+wqwake(struct waitq *q)
 {
   struct proc *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan) {
+  if((p = q->head) == 0)
+    return 0;
+  if((q->head = p->wqnext) == 0)
+    q->tail = 0;
+  p->waitq = 0;
+  wakeup(&p->waitq);
+  return p;
+}
 
-      // [Eli] Add process to runnable from sleeping list. There is no need to obtain and
-      // release lock since this is handled by the wrapper function, wakeup().
-      remove(p, &ptable.pLists.sleep, SLEEPING);
-      p->state = RUNNABLE;
-      addtotail(p, &ptable.pLists.runnable[p->prio], RUNNABLE);
+// Lend our priority to owner, which holds a sleep lock or buffer we
+// are about to wait for, so work ranked between us can't keep it, and
+// so us, off the CPU. Only the MLFQ ranks by priority, and only one
+// level of waiting is followed. The loan lasts until owner drops the
+// last lock it holds; see droplock(). Called with the lock guarding
+// the wait held.
+void
+lendprio(struct proc *owner)
+{
+#ifdef CS333_P3P4
+  int prio;
+
+  if(owner == 0 || owner == proc)
+    return;
+  prio = proc->rtran ? 0 : runprio(proc, ptable.epoch);
+  acquire(&owner->lock);
+  if(owner->policy == SCHED_MLFQ && !owner->onrtq &&
+     prio < runprio(owner, ptable.epoch)){
+    trace(TR_INHERIT, owner, prio);
+    // A queued owner moves to the queue for the level it now runs at.
+    if(owner->state == RUNNABLE){
+      dequeue(owner);
+      syncprio(owner, ptable.epoch);
+      owner->inherit = prio;
+      enqueue(owner);
+    } else {
+      syncprio(owner, ptable.epoch);
+      owner->inherit = prio;
     }
+  }
+  release(&owner->lock);
+#endif
+}
 
+// Count a sleep lock or buffer we now hold.
+void
+holdlock(void)
+{
+  proc->nlocks++;
 }
-#endif
 
-// Wake up all processes sleeping on chan.
+// Count one dropped. Once we hold none, give back any priority we
+// were lent; our own, with its budget, was charged as usual meanwhile.
+// If that leaves queued work ranked above us, yield at the next
+// chance instead of at the end of the slice.
 void
-wakeup(void *chan)
+droplock(void)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+#ifdef CS333_P3P4
+  struct proc *next;
+
+  if(--proc->nlocks > 0 || proc->inherit == MAX)
+    return;
+  acquire(&proc->lock);
+  proc->inherit = MAX;
+  acquire(&cpu->rqlock);
+  if(((next = cpu->rtq.head) || (next = policies[cpu->policy].next(cpu, 0))) &&
+     preempts(next, proc))
+    cpu->needresched = 1;
+  release(&cpu->rqlock);
+  release(&proc->lock);
+#else
+  proc->nlocks--;
+#endif
 }
 
 // Kill the process with the given pid.
@@ -762,44 +1341,60 @@ kill(int pid)
 {
   struct proc *p;
 
-  acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+  if((p = findproc(pid)) == 0)
+    return -1;
+  acquire(&p->lock);
+  if(p->pid != pid){
+    release(&p->lock);
+    return -1;
   }
-  release(&ptable.lock);
-  return -1;
+  p->killed = 1;
+  // Wake process from sleep if necessary.
+  if(p->state == SLEEPING) {
+    p->state = RUNNABLE;
+    trace(TR_WAKEUP, p, (uint)p->chan);
+  }
+  release(&p->lock);
+  return 0;
 }
 #else
 int
 kill(int pid)
 {
   struct proc *p;
+  void *chan = 0;
+  int h;
 
-  acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING) {
-
-        // [Eli] Add process to runnable from sleeping list.
-        remove(p, &ptable.pLists.sleep, SLEEPING);
-        p->state = RUNNABLE;
-        addtotail(p, &ptable.pLists.runnable[p->prio], RUNNABLE);
-      }
-      release(&ptable.lock);
-      return 0;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  acquire(&p->lock);
+  if(p->pid != pid){
+    release(&p->lock);
+    return -1;
+  }
+  p->killed = 1;
+  if(p->state == SLEEPING)
+    chan = p->chan;
+  release(&p->lock);
+
+  // Wake process from sleep if necessary. Its bucket lock comes
+  // before p->lock, so look again once we hold both.
+  if(chan) {
+    h = sleephash(chan);
+    acquire(&ptable.sleeplock[h]);
+    acquire(&p->lock);
+    if(p->pid == pid && p->state == SLEEPING && p->chan == chan) {
+
+      // [Eli] Add process to runnable from sleeping list.
+      remove(p, &ptable.pLists.sleep[h], SLEEPING);
+      p->state = RUNNABLE;
+      trace(TR_WAKEUP, p, (uint)chan);
+      enqueue(p);
     }
+    release(&p->lock);
+    release(&ptable.sleeplock[h]);
   }
-  release(&ptable.lock);
-  return -1;
+  return 0;
 }
 #endif
 
@@ -824,10 +1419,11 @@ procdump(void)
   struct proc *p;
   char *state;
   uint pc[10];
+  uint cpums;
 
   cprintf("\nPID	Name 	UID 	GID	PPID Prio  CPU 	Elapsed State	Size 		PCs\n");
   
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = nextproc(0); p; p = nextproc(p)){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -836,7 +1432,8 @@ procdump(void)
       state = "???";
     if(p->pid != 1)
     	ppid = p->parent->pid;
-		cprintf("%d 	%s 	%d 	%d  	%d    %d	   %d.%d%d %d.%d%d 	%s 	%d", p->pid, p->name, p->uid, p->gid, ppid, p->prio, (p->cpu_ticks_total/100), ((p->cpu_ticks_total % 100)/10),(p->cpu_ticks_total%10), (ticks - p->start_ticks)/100, ((ticks - p->start_ticks) % 100)/10, (ticks - p->start_ticks) %10, state, p->sz);    
+    cpums = divu64(tsc2us(p->cpu_cycles_total), 1000, 0);
+		cprintf("%d 	%s 	%d 	%d  	%d    %d	   %d.%d%d%d %d.%d%d 	%s 	%d", p->pid, p->name, p->uid, p->gid, ppid, runprio(p, ptable.epoch), (cpums/1000), ((cpums % 1000)/100), ((cpums % 100)/10), (cpums%10), (ticks - p->start_ticks)/100, ((ticks - p->start_ticks) % 100)/10, (ticks - p->start_ticks) %10, state, p->sz);    
 		if(p->state == SLEEPING){
       getcallerpcs((uint*)p->context->ebp+2, pc);
       cprintf("		");
@@ -858,57 +1455,147 @@ getuproc(uint max, struct uproc * u)
 
 	int count = 0;
 
-	acquire(&ptable.lock);
+	// waitlock keeps every parent around while we read its pid.
+	acquire(&ptable.waitlock);
 
-	for(p = ptable.proc; p < &ptable.proc[NPROC] && p < &ptable.proc[max]; p++)
+	for(p = nextproc(0); p && count < max; p = nextproc(p))
 	{
-		if(p->state == UNUSED || p->state == EMBRYO)
+		acquire(&p->lock);
+		if(p->state == UNUSED || p->state == EMBRYO) {
+			release(&p->lock);
 			continue;
+		}
 		u->pid = p->pid;
 		u->uid = p->uid;
 		u->gid = p->gid;
-    u->prio = p->prio;
+    u->prio = runprio(p, ptable.epoch);
 		if(p->pid == 1)
 			u->ppid = 1;
 		else
 			u->ppid = p->parent->pid;
 		u->elapsed_ticks = ticks - p->start_ticks;
-		u->CPU_total_ticks = p->cpu_ticks_total;
+		u->CPU_total_secs = divu64(tsc2us(p->cpu_cycles_total), 1000000, &u->CPU_total_usecs);
 		safestrcpy(u->state, states[p->state], sizeof(u->state)/sizeof(char));
 		u->size = p->sz;
+		u->affinity = p->affinity;
 		safestrcpy(u->name, p->name, sizeof(u->name)/sizeof(char));
+		release(&p->lock);
 		u++;
 		count++;
 	}
 
-	release(&ptable.lock);
+	release(&ptable.waitlock);
 	return count;
 }
 
 
+/**
+ * Sets p's name, bumping p->seq around the copy so procsnap() never
+ * returns half of one name and half of another.
+ */
+void
+setname(struct proc * p, char * name)
+{
+  p->seq++;
+  asm volatile("" ::: "memory");
+  safestrcpy(p->name, name, sizeof(p->name));
+  asm volatile("" ::: "memory");
+  p->seq++;
+}
+
+/**
+ * Copies live processes into buf, up to max, starting at proc slot *cursor, and leaves
+ * *cursor where the next call should start, or -1 after the last slot. Slots are
+ * numbered in slab order, and slabs only ever get added, so a cursor stays good
+ * between calls. Takes no locks:
+ * p->seq changes around a pid or name change, so a record is retried until it reads the
+ * same seq, even, on both sides. Other fields are single words read once each, so a
+ * record can mix values from a few instructions apart but never from two processes.
+ */
+int
+procsnap(int * cursor, struct procsnap * buf, int max)
+{
+  struct proc * p;
+  struct proc * parent;
+  struct procsnap r;
+  uint64 cycles, pass;
+  struct procslab * s;
+  uint seq;
+  int i, n = 0;
+
+  // Skip whole slabs up to the one holding the cursor.
+  s = *cursor < 0 ? 0 : ptable.slabs;
+  for(i = *cursor; s && i >= NPROCSLAB; i -= NPROCSLAB)
+    s = s->next;
+  if(s == 0) {
+    *cursor = -1;
+    return 0;
+  }
+
+  for(p = &s->proc[i], i = *cursor; p && n < max; p = nextproc(p), i++) {
+    do {
+      while((seq = p->seq) & 1)
+        ;
+      asm volatile("" ::: "memory");
+      r.state = p->state;
+      if(r.state == UNUSED || r.state == EMBRYO)
+        break;
+      r.pid = p->pid;
+      parent = p->parent;
+      r.ppid = parent ? parent->pid : r.pid;
+      r.uid = p->uid;
+      r.gid = p->gid;
+      r.prio = runprio(p, ptable.epoch);
+      r.tickets = p->tickets;
+      do {
+        pass = *(volatile uint64 *)&p->pass;
+      } while(pass != *(volatile uint64 *)&p->pass);
+      r.cpu = p->cpuid;
+      r.affinity = p->affinity;
+      r.size = p->sz;
+      r.elapsed_ticks = ticks - p->start_ticks;
+      do {
+        cycles = *(volatile uint64 *)&p->cpu_cycles_total;
+      } while(cycles != *(volatile uint64 *)&p->cpu_cycles_total);
+      memmove(r.name, p->name, sizeof(r.name));
+      asm volatile("" ::: "memory");
+    } while(p->seq != seq);
+
+    if(r.state == UNUSED || r.state == EMBRYO)
+      continue;
+    r.name[sizeof(r.name) - 1] = 0;
+    r.CPU_total_secs = divu64(tsc2us(cycles), 1000000, &r.CPU_total_usecs);
+    r.pass = divu64(pass, STRIDE1, 0);
+    buf[n++] = r;
+  }
+
+  *cursor = p ? i : -1;
+  return n;
+}
+
 /**
  * [Eli] Prints to the console the number of processes in the unused list.
  */
 int freedump() {
+  uint khit = 0, kmiss = 0, phit = 0, pmiss = 0;
 
-  acquire(&ptable.lock);
-  struct proc * curr = ptable.pLists.unused;
+  acquire(&ptable.freelock);
 
-  // Since we check for next pointers and cover the 0 free cases in the next statement this is safe.
-  int count = 1; 
+  cprintf("Number of unused processes is: %d\n", ptable.pLists.unused.count);
 
-  if(!curr)
-    return 0;
+  release(&ptable.freelock);
 
-  while(curr->next)
-  {
-    count++;
-    curr = curr->next;
+  // Per-CPU cache counters, summed without locks.
+  for(struct cpu *c = cpus; c < &cpus[ncpu]; c++) {
+    khit += c->kstackhit;
+    kmiss += c->kstackmiss;
+    phit += c->pgdirhit;
+    pmiss += c->pgdirmiss;
   }
-
-  cprintf("Number of unused processes is: %d\n", count);
-
-  release(&ptable.lock);
+  cprintf("Kernel stack cache: %d hits, %d misses, %d%% hit rate\n",
+    khit, kmiss, khit + kmiss ? khit * 100 / (khit + kmiss) : 0);
+  cprintf("Page table cache: %d hits, %d misses, %d%% hit rate\n",
+    phit, pmiss, phit + pmiss ? phit * 100 / (phit + pmiss) : 0);
 
   return 0;
 }
@@ -918,29 +1605,53 @@ int freedump() {
  */
 int runnabledump() {
 
-  for(int i = 0; i < MAX; i++) {
-    acquire(&ptable.lock);
-    struct proc * curr = ptable.pLists.runnable[i];
+  for(struct cpu *c = cpus; c < &cpus[ncpu]; c++) {
+    cprintf("\ncpu%d: %d runnable", c->id, c->nrunnable);
+    #ifdef CS333_P3P4
+    cprintf(" under %s", policies[c->policy].name);
+    #endif
+    acquire(&c->rqlock);
+    if(c->rtq.head) {
+      cprintf("\nRT: Runnable Procs: ");
+      for(struct proc * curr = c->rtq.head; curr; curr = curr->next)
+        cprintf("(%d, %d)%s", curr->pid, curr->rtbudget, curr->next ? " -> " : " ");
+    }
+    if(c->strideq.head) {
+      cprintf("\nStride: Runnable Procs: ");
+      for(struct proc * curr = c->strideq.head; curr; curr = curr->next)
+        cprintf("(%d, %d)%s", curr->pid, curr->tickets, curr->next ? " -> " : " ");
+    }
+    if(c->rrq.head) {
+      cprintf("\nRR: Runnable Procs: ");
+      for(struct proc * curr = c->rrq.head; curr; curr = curr->next)
+        cprintf("%d%s", curr->pid, curr->next ? " -> " : " ");
+    }
+    release(&c->rqlock);
+    for(int i = 0; i < MAX; i++) {
+      acquire(&c->rqlock);
+      syncqueues(c);
+      struct proc * curr = runq(c, i)->head;
 
 
-    if(!curr) {
-      cprintf("\n%d: No processes in the runnable list", i);
-      release(&ptable.lock);
-      continue;
-    }
+      if(!curr) {
+        cprintf("\n%d: No processes in the runnable list", i);
+        release(&c->rqlock);
+        continue;
+      }
 
-    cprintf("\n%d: Runnable Procs: ", i);
-    while(curr->next)
-    {
-      cprintf("(%d, %d) -> ", curr->pid, curr->budget);
-      curr = curr->next;
-    }
+      cprintf("\n%d: Runnable Procs: ", i);
+      while(curr->next)
+      {
+        cprintf("(%d, %d) -> ", curr->pid, curr->budget);
+        curr = curr->next;
+      }
 
-    cprintf("(%d, %d) ", curr->pid, curr->budget);
+      cprintf("(%d, %d) ", curr->pid, curr->budget);
+      cprintf("\n");
+      release(&c->rqlock);
+    }
     cprintf("\n");
-    release(&ptable.lock);
   }
-  cprintf("\n");
   return 0;
 }
 
@@ -949,27 +1660,32 @@ int runnabledump() {
  */
 int sleepdump() {
 
-  acquire(&ptable.lock);
-  struct proc * curr = ptable.pLists.sleep;
+  int found = 0;
 
+  for(int i = 0; i < NSLEEPQ; i++) {
+    acquire(&ptable.sleeplock[i]);
+    struct proc * curr = ptable.pLists.sleep[i].head;
 
-  if(!curr) {
-    cprintf("No processes in the sleep list\n");
-    release(&ptable.lock);
-    return 0;
-  }
+    if(!curr) {
+      release(&ptable.sleeplock[i]);
+      continue;
+    }
 
-  cprintf("Sleeping Procs: ");
-  while(curr->next)
-  {
-    cprintf("%d -> ", curr->pid);
-    curr = curr->next;
+    if(!found)
+      cprintf("Sleeping Procs: ");
+    found = 1;
+    while(curr)
+    {
+      cprintf("%d -> ", curr->pid);
+      curr = curr->next;
+    }
+    release(&ptable.sleeplock[i]);
   }
 
-  cprintf("%d -> ", curr->pid);
+  if(!found)
+    cprintf("No processes in the sleep list");
 
   cprintf("\n");
-  release(&ptable.lock);
 
   return 0;
 }
@@ -979,13 +1695,13 @@ int sleepdump() {
  */
 int zombiedump() {
 
-  acquire(&ptable.lock);
-  struct proc * curr = ptable.pLists.zombie;
+  acquire(&ptable.waitlock);
+  struct proc * curr = ptable.pLists.zombie.head;
 
 
   if(!curr) {
     cprintf("No processes in zombie list\n");
-    release(&ptable.lock);
+    release(&ptable.waitlock);
     return 0;
   }
 
@@ -999,168 +1715,1301 @@ int zombiedump() {
   cprintf("(%d, %d) -> ", curr->pid, curr->parent->pid);
 
   cprintf("\n");
-  release(&ptable.lock);
+  release(&ptable.waitlock);
 
   return 0;
 }
 
 
 /**
- * [Eli] Takes a pointer to the head pointer and a state enum.
+ * [Eli] Takes a pointer to a list and a state enum.
  * If there are no processes to remove, return a null pointer, this functionality is required for the scheduler.
- * If the to be removed process is not of the correct state, panic.
+ * If the to be removed process is not of the correct state, panic (DEBUG_LISTS builds only).
  */
-struct proc * removefromhead(struct proc ** list, enum procstate state) {
+struct proc * removefromhead(struct proclist * list, enum procstate state) {
 
-  struct proc * proc = *list;
+  struct proc * proc = list->head;
   if(!proc) {
     return proc;
   }
 
-  if((*list)->state != state)
-  panic("Incorrect state, won't find proc to remove");
-
-  *list = (*list)->next;
+  remove(proc, list, state);
   return proc;
 }
 
 /** 
- * [Eli] Takes a pointer to a process, a pointer the list's head pointer, and a state enum.
- * If the process to be added has the wrong state, panic. Otherwise, add to the head of the list and update the head pointer.
+ * [Eli] Takes a pointer to a process, a pointer to the list, and a state enum.
+ * Adds the process to the head of the list in constant time. With DEBUG_LISTS, panic if the process has the wrong state.
  */
-void addtohead(struct proc * p, struct proc ** list, enum procstate state) {
+void addtohead(struct proc * p, struct proclist * list, enum procstate state) {
+#ifdef DEBUG_LISTS
   if(p->state != state) {
     panic("Incorrect state, cannot add to head");
   }
-  p->next = *list;
-  (*list) = p;
-
-  return;
-
+#endif
+  p->prev = 0;
+  p->next = list->head;
+  if(list->head)
+    list->head->prev = p;
+  else
+    list->tail = p;
+  list->head = p;
+  list->count++;
 }
 
 /**
- * [Eli] Takes a pointer to a process, a pointer to the list's head pointer, and a state enum.
- * If the process to be removed has the wrong state, panic. Otherwise search the list to find the process to remove and remove it.
- * If the to be removed process can't be found, panic.
+ * [Eli] Takes a pointer to a process, a pointer to the list, and a state enum.
+ * Unlinks the process in constant time using its prev and next links.
+ * With DEBUG_LISTS, panic if the process has the wrong state or can't be found on the list.
  */
-void remove(struct proc * p, struct proc ** list, enum procstate state) {
+void remove(struct proc * p, struct proclist * list, enum procstate state) {
+#ifdef DEBUG_LISTS
+  struct proc * curr;
 
   if(p->state != state)
     panic("Incorrect state, won't find proc to remove");
 
-  while((*list) != p && (*list) != 0) {
-    list = &(*list)->next;
-  }
+  for(curr = list->head; curr && curr != p; curr = curr->next)
+    ;
+  if(!curr)
+    panic("Could not find process to remove!");
+#endif
 
-  if((*list) == p) {
-    (*list) = p->next;
-    return;
-  }
-  
-  panic("Could not find process to remove!");
+  if(p->prev)
+    p->prev->next = p->next;
+  else
+    list->head = p->next;
+  if(p->next)
+    p->next->prev = p->prev;
+  else
+    list->tail = p->prev;
 
-  return;
+  p->next = 0;
+  p->prev = 0;
+  list->count--;
 }
 
 /**
- * [Eli] Takes a pointer to a process, a pointer the the list's head, and a state enum.
- * If the process to add has the wrong state, panic. Otherwise, go to the end of the list and add to its tail. 
+ * [Eli] Takes a pointer to a process, a pointer to the list, and a state enum.
+ * Adds the process after the list's tail pointer in constant time. With DEBUG_LISTS, panic if the process has the wrong state.
  */
-void addtotail(struct proc * p, struct proc ** list, enum procstate state) {
+void addtotail(struct proc * p, struct proclist * list, enum procstate state) {
+#ifdef DEBUG_LISTS
   if(p->state != state)
     panic("Incorrect state, cannot add to tail");
-  
-  while((*list))
-    list = &(*list)->next;
-
-  (*list) = p;
+#endif
   p->next = 0;
-  
+  p->prev = list->tail;
+  if(list->tail)
+    list->tail->next = p;
+  else
+    list->head = p;
+  list->tail = p;
+  list->count++;
 }
 
-void promoterunnable() {
+/**
+ * Returns pid's process locked, or 0. Only SLEEPING, RUNNABLE and RUNNING
+ * processes count unless any is set, in which case anything not UNUSED does.
+ */
+static struct proc * lockproc(int pid, int any) {
+  struct proc * p;
 
+  if((p = findproc(pid)) == 0)
+    return 0;
+  acquire(&p->lock);
+  if(p->pid == pid && (p->state == SLEEPING || p->state == RUNNABLE || p->state == RUNNING ||
+      (any && p->state != UNUSED)))
+    return p;
+  release(&p->lock);
+  return 0;
+}
+
+int setprio(int pid, int prio) {
+  struct proc * p = lockproc(pid, 0);
+
+  if(!p)
+    return -1;
+
+  // A runnable process has to move to the queue for its new priority.
+  #ifdef CS333_P3P4
+  if(p->state == RUNNABLE) {
+    dequeue(p);
+    p->prio = prio;
+    p->budget = ptable.budget[prio];
+    enqueue(p);
+    release(&p->lock);
+    return 0;
+  }
+  #endif
+  p->prio = prio;
+  p->budget = ptable.budget[prio];
+  p->epoch = ptable.epoch;
+
+  release(&p->lock);
+  return 0;
+}
+
+/**
+ * Gives pid n tickets: under the stride policy its share of a CPU is n over
+ * the tickets of everything queued there. Takes effect from its next charge.
+ */
+int settickets(int pid, int n) {
   struct proc * p;
 
-  //Bump all in runnable lists up by 1
-  for(int i = 1; i < MAX; i++) {
-    while(ptable.pLists.runnable[i]) {
-      p = removefromhead(&ptable.pLists.runnable[i], RUNNABLE);
-      p->prio--;
-      p->budget = BUDGET;
-      addtotail(p, &ptable.pLists.runnable[i - 1], RUNNABLE);
+  if(n < 1 || n > MAXTICKETS)
+    return -1;
+  if((p = lockproc(pid, 0)) == 0)
+    return -1;
+  p->tickets = n;
+  p->stride = STRIDE1 / n;
+  release(&p->lock);
+  return 0;
+}
+
+/**
+ * Counts a timer tick against the running process's time slice. Returns 1 once
+ * the slice its policy gives it is used up, and trap() makes it yield. Real-time
+ * runs stay at one tick, so an overrun of the reservation is caught promptly.
+ */
+int sliceover(void) {
+  #ifdef CS333_P3P4
+  struct policy * pol = &policies[proc->policy];
+
+  return ++proc->sliceticks >= (pol->slice && !proc->rtran ? pol->slice(proc) : 1);
+  #else
+  return 1;
+  #endif
+}
+
+/**
+ * Sets the number of ticks between MLFQ priority boosts, counting from the
+ * last one. Returns the old interval, or with n negative just reports it.
+ */
+int setboost(int n) {
+  int old = ptable.boostticks;
+
+  if(n == 0)
+    return -1;
+  if(n > 0)
+    ptable.boostticks = n;
+  return old;
+}
+
+/**
+ * Sets the MLFQ time slice and budget at priority prio, both in ticks. Budgets
+ * already running down keep going; the new one applies from the next refill.
+ */
+int setquantum(int prio, int quantum, int budget) {
+  if(prio < 0 || prio >= MAX || quantum < 1 || budget < 1 || budget > 0x7fffffff / USPERTICK)
+    return -1;
+  ptable.quantum[prio] = quantum;
+  ptable.budget[prio] = budget * USPERTICK;
+  return 0;
+}
+
+/**
+ * Fills in st with the MLFQ tunables and every CPU's counters, summed by priority,
+ * and the dispatches every CPU has made whatever the policy. The counters are read
+ * without locks; run time is 64 bits, so it is read until it holds still.
+ */
+int mlfqstat(struct mlfqstat * st) {
+  struct levelcount * l;
+  struct cpu * c;
+  uint64 us, total;
+  int i;
+
+  st->boost = ptable.boostticks;
+  st->switches = 0;
+  for(c = cpus; c < &cpus[ncpu]; c++)
+    st->switches += c->switches;
+  for(i = 0; i < MAX; i++) {
+    st->level[i].quantum = ptable.quantum[i];
+    st->level[i].budget = ptable.budget[i] / USPERTICK;
+    st->level[i].dispatches = 0;
+    st->level[i].demotions = 0;
+    total = 0;
+    for(c = cpus; c < &cpus[ncpu]; c++) {
+      l = &c->levels[i];
+      st->level[i].dispatches += l->dispatches;
+      st->level[i].demotions += l->demotions;
+      do {
+        us = *(volatile uint64 *)&l->runus;
+      } while(us != *(volatile uint64 *)&l->runus);
+      total += us;
     }
+    st->level[i].runms = divu64(total, 1000, 0);
+  }
+  return 0;
+}
+
+/**
+ * Adds lk's contention to *spins and *cycles. Read without the lock; the
+ * 64-bit cycle count is read until it holds still.
+ */
+static void addspins(struct spinlock * lk, uint * spins, uint64 * cycles) {
+  uint64 t;
+
+  do {
+    t = *(volatile uint64 *)&lk->spincycles;
+  } while(t != *(volatile uint64 *)&lk->spincycles);
+  *spins += lk->nspin;
+  *cycles += t;
+}
+
+/**
+ * Fills in up to n entries of ls with the contention on the process table's locks
+ * since boot, and returns how many it filled. Per-proc, per-cpu and per-bucket locks
+ * are each summed into one entry.
+ */
+int lockstat(struct lockstat * ls, int n) {
+  static char * names[NLOCKSTAT] = { "proc", "rqlock", "sleepq", "wait", "free", "pid", "rt", "policy" };
+  struct spinlock * single[] = { &ptable.waitlock, &ptable.freelock, &ptable.pidlock,
+    &ptable.rtlock, &ptable.policylock };
+  uint spins[NELEM(names)];
+  uint64 cycles[NELEM(names)];
+  struct proc * p;
+  struct cpu * c;
+  int i;
+
+  memset(spins, 0, sizeof(spins));
+  memset(cycles, 0, sizeof(cycles));
+  for(p = nextproc(0); p; p = nextproc(p))
+    addspins(&p->lock, &spins[0], &cycles[0]);
+  for(c = cpus; c < &cpus[ncpu]; c++)
+    addspins(&c->rqlock, &spins[1], &cycles[1]);
+  for(i = 0; i < NSLEEPQ; i++)
+    addspins(&ptable.sleeplock[i], &spins[2], &cycles[2]);
+  for(i = 0; i < NELEM(single); i++)
+    addspins(single[i], &spins[3 + i], &cycles[3 + i]);
+
+  if(n > NLOCKSTAT)
+    n = NLOCKSTAT;
+  for(i = 0; i < n; i++) {
+    safestrcpy(ls[i].name, names[i], sizeof(ls[i].name));
+    ls[i].spins = spins[i];
+    ls[i].spinus = tsc2us(cycles[i]);
   }
+  return n;
+}
 
-  struct proc * curr = ptable.pLists.sleep;
-  while (curr) {
-    if(curr->prio > 0) {
-      curr->prio--;
-      curr->budget = BUDGET;
+/**
+ * Switches every CPU to scheduling policy n, or with n negative just reports.
+ * Returns the policy in force before, or -1 if n is no policy. New work goes
+ * on the new policy's queues at once; work already queued is moved over a
+ * process at a time afterwards, the way isolcpus() moves it, so the CPUs
+ * never stop to wait for the switch.
+ */
+int setpolicy(int n) {
+  #ifndef CS333_P3P4
+  // Round robin over the proc table is all this build has.
+  if(n >= 0 && n != SCHED_RR)
+    return -1;
+  return SCHED_RR;
+  #else
+  struct proc * p;
+  struct cpu * c;
+  int old, i;
+
+  if(n >= NPOLICY)
+    return -1;
+  if(n < 0)
+    return ptable.policy;
+
+  acquire(&ptable.policylock);
+  old = ptable.policy;
+  ptable.policy = n;
+  for(c = cpus; c < &cpus[ncpu]; c++) {
+    acquire(&c->rqlock);
+    c->policy = n;
+    release(&c->rqlock);
+  }
+  release(&ptable.policylock);
+
+  // Anything still on another policy's queues is requeued under its
+  // own lock, which puts it on the queues of the policy now in force.
+  for(c = cpus; c < &cpus[ncpu]; c++) {
+    for(i = 0; i < NPOLICY; i++) {
+      for(;;) {
+        acquire(&c->rqlock);
+        p = i == c->policy ? 0 : policies[i].next(c, 0);
+        release(&c->rqlock);
+        if(!p)
+          break;
+
+        acquire(&p->lock);
+        if(p->state == RUNNABLE && p->cpuid == c->id && !p->onrtq && p->policy == i) {
+          dequeue(p);
+          enqueue(p);
+        }
+        release(&p->lock);
+      }
     }
-    curr = curr->next;
   }
+  return old;
+  #endif
+}
+
+/**
+ * Restricts pid to the cpus in mask. A queued process moves to an allowed
+ * CPU now; a running one moves the next time it gives up the CPU. A real-time
+ * reservation on a cpu mask leaves out moves too, and the call fails if no
+ * cpu in mask has room for it.
+ */
+int setaffinity(int pid, uint mask) {
+  struct proc * p;
+  uint old;
+  int r;
+
+  mask &= ALLCPUS;
+  if((mask & ((1 << ncpu) - 1)) == 0)
+    return -1;
+
+  if((p = lockproc(pid, 1)) == 0 || p->state == ZOMBIE) {
+    if(p)
+      release(&p->lock);
+    return -1;
+  }
+
+  #ifdef CS333_P3P4
+  if(p->state == RUNNABLE)
+    dequeue(p);
+  #endif
+  old = p->affinity;
+  p->affinity = mask;
+  if((r = rtmove(p, cpumask(p))) < 0)
+    p->affinity = old;
+  #ifdef CS333_P3P4
+  if(p->state == RUNNABLE)
+    enqueue(p);
+  #endif
+
+  release(&p->lock);
+  return r;
+}
+
+/**
+ * Makes p, if it is still process pid and queued, the next process this CPU runs, moving
+ * it here from another CPU's queue if it may run here. The caller is about to give up
+ * the CPU, by yielding or sleeping, and wants its partner to have the rest of its slice
+ * instead of whatever is at the head of the queues, as long as that doesn't outrank p.
+ * It is only a hint: if p gets stolen or runs elsewhere first, the scheduler carries on
+ * as usual. Real-time processes keep
+ * to their reserved CPU. Must be called without any p->lock held. Returns -1 if p can't
+ * be handed the CPU.
+ */
+int handoff(struct proc * p, int pid) {
+  #ifdef CS333_P3P4
+  acquire(&p->lock);
+  if(p->pid != pid || p->state != RUNNABLE || p->onrtq || (cpumask(p) & (1 << cpu->id)) == 0) {
+    release(&p->lock);
+    return -1;
+  }
+  if(p->cpuid != cpu->id) {
+    dequeue(p);
+    p->cpuid = cpu->id;
+    enqueue(p);
+  }
+  cpu->handoff = p;
+  cpu->handoffticks = proc->sliceticks;
+  trace(TR_HANDOFF, p, proc->pid);
+  release(&p->lock);
+  return 0;
+  #else
+  // The round-robin scheduler has no queue to jump.
+  return -1;
+  #endif
+}
+
+/**
+ * Returns the share of a cpu, in permille and rounded up, that runtime out of every period takes.
+ */
+static uint rtshare(uint period, uint runtime) {
+  return divu64((uint64)runtime * 1000 + period - 1, period, 0);
+}
+
+/**
+ * Gives back p's real-time reservation, if it has one. Called with p->lock held.
+ */
+static void rtdrop(struct proc * p) {
+  if(p->rtperiod == 0)
+    return;
+  acquire(&ptable.rtlock);
+  cpus[p->rtcpu].rtutil -= rtshare(p->rtperiod, p->rtruntime);
+  release(&ptable.rtlock);
+  p->rtperiod = 0;
+}
+
+/**
+ * Moves p's real-time reservation into mask if its reserved cpu isn't in it, admitting
+ * it on the first cpu in mask with room. Returns -1, leaving the reservation where it
+ * was, if none has. Called with p->lock held and p off the queues.
+ */
+static int rtmove(struct proc * p, uint mask) {
+  struct cpu * c;
+  uint share;
+
+  if(p->rtperiod == 0 || (mask & (1 << p->rtcpu)))
+    return 0;
+  share = rtshare(p->rtperiod, p->rtruntime);
+  acquire(&ptable.rtlock);
+  for(c = cpus; c < &cpus[ncpu]; c++)
+    if((mask & (1 << c->id)) && c->rtutil + share <= RTUTIL)
+      break;
+  if(c == &cpus[ncpu]) {
+    release(&ptable.rtlock);
+    return -1;
+  }
+  cpus[p->rtcpu].rtutil -= share;
+  c->rtutil += share;
+  p->rtcpu = c->id;
+  release(&ptable.rtlock);
+  return 0;
+}
 
-  curr = ptable.pLists.running;
-  while (curr) {
-    if(curr->prio > 0) {
-      curr->prio--;
-      curr->budget = BUDGET;
+/**
+ * Makes pid real-time: every period microseconds it gets runtime microseconds of cpu
+ * ahead of all MLFQ levels, earliest deadline first, or with period 0 it goes back to
+ * the MLFQ alone. Admission reserves runtime / period on a cpu pid may run on, the
+ * one it is on if that has room, and fails if no cpu has that much of RTUTIL left.
+ * pid runs its reserved time on that cpu. Once the period's run time is used up it
+ * drops to the MLFQ until the next period, so it can't starve everyone else.
+ */
+int setrealtime(int pid, uint period, uint runtime) {
+  struct proc * p;
+  struct cpu * c;
+  uint share = 0;
+  uint mask;
+
+  if(period && (period < USPERTICK || runtime == 0 || runtime > period))
+    return -1;
+  if(period)
+    share = rtshare(period, runtime);
+
+  if((p = lockproc(pid, 0)) == 0)
+    return -1;
+
+  // Trade the old reservation for the new one, or keep the old one if the new won't fit.
+  mask = cpumask(p);
+  acquire(&ptable.rtlock);
+  if(p->rtperiod)
+    cpus[p->rtcpu].rtutil -= rtshare(p->rtperiod, p->rtruntime);
+  c = 0;
+  if(period) {
+    c = &cpus[p->cpuid];
+    if((mask & (1 << c->id)) == 0 || c->rtutil + share > RTUTIL)
+      for(c = cpus; c < &cpus[ncpu]; c++)
+        if((mask & (1 << c->id)) && c->rtutil + share <= RTUTIL)
+          break;
+    if(c == &cpus[ncpu]) {
+      if(p->rtperiod)
+        cpus[p->rtcpu].rtutil += rtshare(p->rtperiod, p->rtruntime);
+      release(&ptable.rtlock);
+      release(&p->lock);
+      return -1;
     }
-    curr = curr->next;
+    c->rtutil += share;
   }
+  release(&ptable.rtlock);
 
-  curr = ptable.pLists.runnable[0];
-  while(curr) {
-    curr->budget = BUDGET;
-    curr = curr->next;
+  #ifdef CS333_P3P4
+  if(p->state == RUNNABLE)
+    dequeue(p);
+  #endif
+  p->rtperiod = period;
+  if(c) {
+    p->rtruntime = runtime;
+    p->rtbudget = runtime;
+    p->rtdeadline = rdtsc() + us2tsc(period);
+    p->rtcpu = c->id;
   }
+  #ifdef CS333_P3P4
+  if(p->state == RUNNABLE)
+    enqueue(p);
+  #endif
+
+  release(&p->lock);
+  return 0;
 }
 
-int setprio(int pid, int prio) {
-  acquire(&ptable.lock);
-  struct proc * curr;
+/**
+ * Returns pid's affinity mask, or -1 if there is no such process.
+ */
+int getaffinity(int pid) {
+  struct proc * p;
+  int mask = -1;
 
-  curr = ptable.pLists.sleep;
-  while(curr) {
-    if(curr->pid == pid) {
-      curr->prio = prio;
-      curr->budget = BUDGET;
-      release(&ptable.lock);
-      return 0;
+  if((p = lockproc(pid, 1)) != 0) {
+    if(p->state != ZOMBIE)
+      mask = p->affinity;
+    release(&p->lock);
+  }
+  return mask;
+}
+
+/**
+ * Takes the cpus in mask out of general scheduling, leaving them to processes
+ * pinned there. At least one online cpu must stay general. Queued work that
+ * may no longer run where it sits is moved off. Returns the old mask.
+ */
+int isolcpus(uint mask) {
+  uint online = (1 << ncpu) - 1;
+  int old;
+  #ifdef CS333_P3P4
+  struct policy * pol;
+  struct proc * p;
+  struct cpu * c;
+  #endif
+
+  if((online & ~mask) == 0)
+    return -1;
+
+  old = xchg(&ptable.isolated, mask);
+  #ifdef CS333_P3P4
+  for(c = cpus; c < &cpus[ncpu]; c++) {
+    if((mask & (1 << c->id)) == 0)
+      continue;
+
+    // Find a misplaced process under rqlock, then move it under its
+    // own lock, until there are none left.
+    for(;;) {
+      acquire(&c->rqlock);
+      pol = &policies[c->policy];
+      for(p = pol->next(c, 0); p && (cpumask(p) & (1 << c->id)); p = pol->next(c, p))
+        ;
+      release(&c->rqlock);
+      if(!p)
+        break;
+
+      acquire(&p->lock);
+      if(p->state == RUNNABLE && p->cpuid == c->id) {
+        dequeue(p);
+        enqueue(p);
+      }
+      release(&p->lock);
     }
+  }
+  #endif
+  return old;
+}
 
-    curr = curr->next;
+/**
+ * Records a scheduler event for p in this cpu's trace ring, with the priority the
+ * scheduler ranks p by just then: boosts not yet applied and any lent priority
+ * count. Callers hold a spinlock, so interrupts are off and nothing else writes
+ * this ring.
+ */
+static void trace(int type, struct proc * p, uint arg) {
+  struct tracerec * e;
+  uint h = tracebuf.ring[cpu->id].head;
+
+  e = &tracebuf.ring[cpu->id].rec[h % NTRACE];
+  e->tsc = rdtsc();
+  e->pid = p->pid;
+  e->arg = arg;
+  e->type = type;
+  e->prio = runprio(p, ptable.epoch);
+
+  // x86 keeps stores in order; just stop the compiler moving them.
+  asm volatile("" ::: "memory");
+  tracebuf.ring[cpu->id].head = h + 1;
+}
+
+/**
+ * Fills in one trace event for tracedrain().
+ */
+static void putevent(struct traceevent * ev, int cpuid, struct tracerec * e) {
+  struct timeval tv;
+
+  tsctime(e->tsc, &tv);
+  ev->sec = tv.sec;
+  ev->usec = tv.usec;
+  ev->pid = e->pid;
+  ev->arg = e->arg;
+  ev->cpu = cpuid;
+  ev->type = e->type;
+  ev->prio = e->prio;
+  ev->pad = 0;
+}
+
+/**
+ * Copies up to max undrained trace events into buf, oldest first on each
+ * cpu, and returns how many. A TR_LOST event stands in for any that were
+ * overwritten before anyone drained them. Doesn't slow down recording.
+ */
+int tracedrain(struct traceevent * buf, int max) {
+  struct tracerec e;
+  struct tracerec gap;
+  uint h;
+  int i, n = 0;
+
+  acquire(&tracebuf.lock);
+  for(i = 0; i < ncpu && n < max; i++) {
+    while(n < max) {
+      h = tracebuf.ring[i].head;
+      if(h - tracebuf.ring[i].tail > NTRACE) {
+        tracebuf.ring[i].lost += h - NTRACE - tracebuf.ring[i].tail;
+        tracebuf.ring[i].tail = h - NTRACE;
+      }
+      if(tracebuf.ring[i].tail == h)
+        break;
+
+      // The slot is rewritten once head reaches tail + NTRACE, so
+      // the copy is good only if head is still short of that.
+      e = tracebuf.ring[i].rec[tracebuf.ring[i].tail % NTRACE];
+      asm volatile("" ::: "memory");
+      if(tracebuf.ring[i].head - tracebuf.ring[i].tail >= NTRACE) {
+        tracebuf.ring[i].lost++;
+        tracebuf.ring[i].tail++;
+        continue;
+      }
+
+      if(tracebuf.ring[i].lost) {
+        if(n + 1 >= max)
+          break;
+        memset(&gap, 0, sizeof(gap));
+        gap.tsc = e.tsc;
+        gap.type = TR_LOST;
+        gap.arg = tracebuf.ring[i].lost;
+        putevent(&buf[n++], i, &gap);
+        tracebuf.ring[i].lost = 0;
+      }
+      tracebuf.ring[i].tail++;
+      putevent(&buf[n++], i, &e);
+    }
+  }
+  release(&tracebuf.lock);
+  return n;
+}
+
+/**
+ * Adds p to the PID index. Called with pidlock held once p has its pid.
+ */
+static void pidinsert(struct proc * p) {
+  struct proc ** bucket = &ptable.pidhash[p->pid % NPIDHASH];
+
+  p->pidnext = *bucket;
+  *bucket = p;
+}
+
+/**
+ * Drops p from the PID index. Called with pidlock held before p's pid is cleared.
+ * Pids are handed out in order, so each chain stays around nproc / NPIDHASH long.
+ */
+static void pidremove(struct proc * p) {
+  struct proc ** pp = &ptable.pidhash[p->pid % NPIDHASH];
+
+  while(*pp && *pp != p)
+    pp = &(*pp)->pidnext;
+  if(*pp)
+    *pp = p->pidnext;
+  p->pidnext = 0;
+}
+
+/**
+ * Returns the live (non-UNUSED) process with the given pid, or 0. The result is
+ * unlocked and may be reused at any time, so callers lock it and check p->pid.
+ */
+static struct proc * findproc(int pid) {
+  struct proc * p;
+
+  if(pid <= 0)
+    return 0;
+  acquire(&ptable.pidlock);
+  for(p = ptable.pidhash[pid % NPIDHASH]; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+  release(&ptable.pidlock);
+  return p;
+}
+
+#ifdef CS333_P3P4
+/**
+ * Returns the sleep bucket for chan. Channels are mostly word-aligned kernel
+ * addresses, so a multiplicative hash spreads them over the NSLEEPQ buckets.
+ */
+static int sleephash(void * chan) {
+  return ((uint)chan * 2654435761U) >> (32 - NSLEEPQSHIFT);
+}
+
+/**
+ * Returns the priority p has as of epoch: one level better for every boost
+ * since p->epoch, stopping at 0. Doesn't change p, so it is safe without the lock.
+ */
+static int effprio(struct proc * p, uint epoch) {
+  uint n = epoch - p->epoch;
+
+  if(n >= p->prio)
+    return 0;
+  return p->prio - n;
+}
+#endif
+
+/**
+ * Returns the MLFQ level p runs at as of epoch: its own priority or the one a
+ * waiter lent it (see lendprio()), whichever is better, boosted like effprio().
+ * Budget and demotion go by p->prio alone; this is what p is queued and ranked by.
+ */
+static int runprio(struct proc * p, uint epoch) {
+  uint n = epoch - p->epoch;
+  int prio = p->inherit < p->prio ? p->inherit : p->prio;
+
+  if(n >= prio)
+    return 0;
+  return prio - n;
+}
+
+/**
+ * Returns c's queue for priority prio. The queues form a ring starting at c->qbase.
+ */
+static struct proclist * runq(struct cpu * c, int prio) {
+  return &c->runnable[(c->qbase + prio) % MAX];
+}
+
+/**
+ * Brings c's queues up to the current epoch. Called with c->rqlock held. Each boost moves the priority 0
+ * queue onto the front of the priority 1 queue and turns the ring one step,
+ * so every level moves up one with the order kept, whatever the queue lengths.
+ * After MAX - 1 boosts everything is at priority 0, so more are no-ops.
+ */
+static void syncqueues(struct cpu * c) {
+  struct proclist * top;
+  struct proclist * next;
+  uint epoch = ptable.epoch;  // Once: cpu 0 may boost meanwhile
+  uint n = epoch - c->epoch;
+
+  if(n > MAX - 1)
+    n = MAX - 1;
+  c->epoch = epoch;
+
+  while(n-- > 0) {
+    top = runq(c, 0);
+    next = runq(c, 1);
+    if(top->head) {
+      if(next->head) {
+        top->tail->next = next->head;
+        next->head->prev = top->tail;
+      } else
+        next->tail = top->tail;
+      next->head = top->head;
+      next->count += top->count;
+      top->head = top->tail = 0;
+      top->count = 0;
+      c->rqmask |= 1 << (next - c->runnable);
+      c->rqmask &= ~(1 << (top - c->runnable));
+    }
+    c->qbase = (c->qbase + 1) % MAX;
   }
+}
 
-  curr = ptable.pLists.running;
-  while(curr) {
-    if(curr->pid == pid) {
-      curr->prio = prio;
-      curr->budget = BUDGET;
-      release(&ptable.lock);
+/**
+ * Returns the online cpus p may run on. Isolated cpus are left out unless p
+ * is allowed nowhere else, so only processes pinned to them run there.
+ */
+static uint cpumask(struct proc * p) {
+  uint online = (1 << ncpu) - 1;
+  uint mask = p->affinity & online & ~ptable.isolated;
+
+  if(mask == 0)
+    mask = p->affinity & online;
+  return mask;
+}
+
+#ifdef CS333_P3P4
+/**
+ * Applies the boosts p has missed up to epoch. A boost also refills the budget,
+ * and lifts a lent priority along with p's own. Called with p->lock held. A
+ * queued process is synced to its queue's epoch, never past it, so that
+ * runprio() keeps naming the queue it is on.
+ */
+static void syncprio(struct proc * p, uint epoch) {
+  uint n = epoch - p->epoch;
+
+  if(n == 0)
+    return;
+  if(p->inherit < MAX)
+    p->inherit = n >= p->inherit ? 0 : p->inherit - n;
+  if(effprio(p, epoch) != p->prio)
+    trace(TR_BOOST, p, effprio(p, epoch));
+  p->prio = effprio(p, epoch);
+  p->budget = ptable.budget[p->prio];
+  p->epoch = epoch;
+}
+
+/**
+ * Puts a RUNNABLE process on its CPU's real-time queue if it has run time left
+ * this period, else on that CPU's queues for its current policy.
+ * A process stays with the CPU it last ran on so its cache stays warm,
+ * unless its affinity no longer allows that CPU. Called with p->lock held.
+ */
+static void enqueue(struct proc * p) {
+  uint mask = cpumask(p);
+  struct cpu * c;
+
+  if(p->rtperiod) {
+    rtrefill(p);
+    if(p->rtbudget > 0) {
+      rtenqueue(p);
+      return;
+    }
+  }
+  p->onrtq = 0;
+
+  if((mask & (1 << p->cpuid)) == 0)
+    p->cpuid = leastloaded(mask);
+  c = &cpus[p->cpuid];
+
+  acquire(&c->rqlock);
+  p->policy = c->policy;
+  policies[p->policy].enqueue(c, p);
+  c->nrunnable++;
+  release(&c->rqlock);
+  kick(c, p);
+}
+
+/**
+ * Lets c know about p, just queued there. An idle c gets an IPI so it finds p now
+ * rather than at its next timer interrupt, which may be ticks away; kicked keeps
+ * that to one IPI per idle spell. A busy c is only disturbed if p outranks the
+ * process running there: c->needresched makes that process yield at its next
+ * trap exit, and the IPI makes that happen now on another CPU. Called after
+ * queueing, with interrupts off.
+ */
+static void kick(struct cpu * c, struct proc * p) {
+  struct proc * cur;
+
+  if(c->idle) {
+    if(c != cpu && xchg(&c->kicked, 1) == 0)
+      lapicipi(c->id, T_IRQ0 + IRQ_RESCHED);
+    return;
+  }
+  cur = c->proc;
+  if(cur && cur != p && preempts(p, cur) && xchg(&c->needresched, 1) == 0 && c != cpu)
+    lapicipi(c->id, T_IRQ0 + IRQ_RESCHED);
+}
+
+/**
+ * Returns 1 if queued p should take the CPU from running cur: real-time beats
+ * the rest and an earlier deadline beats a later one, then p's policy decides.
+ * cur isn't locked and may already be switching out, so this is only a hint.
+ */
+static int preempts(struct proc * p, struct proc * cur) {
+  struct policy * pol = &policies[p->policy];
+
+  if(p->onrtq)
+    return !cur->rtran || p->rtdeadline < cur->rtdeadline;
+  if(cur->rtran || cur->policy != p->policy || !pol->preempts)
+    return 0;
+  return pol->preempts(p, cur);
+}
+
+/**
+ * Takes a RUNNABLE process off whichever CPU queue it is sitting on: the rtq, or the
+ * queues of the policy it was put on, which may not be the CPU's policy any more.
+ * Called with p->lock held.
+ */
+static void dequeue(struct proc * p) {
+  struct cpu * c = &cpus[p->cpuid];
+
+  acquire(&c->rqlock);
+  if(p->onrtq) {
+    remove(p, &c->rtq, RUNNABLE);
+    c->nrt--;
+  } else
+    policies[p->policy].dequeue(c, p);
+  c->nrunnable--;
+  release(&c->rqlock);
+  p->rtran = p->onrtq;
+  p->onrtq = 0;
+}
+
+/**
+ * Starts a new period for real-time p if the last one is over: its deadline moves
+ * on a period, or to a period from now if it slept through whole periods, and its
+ * run time is refilled. Called with p->lock held.
+ */
+static void rtrefill(struct proc * p) {
+  uint64 now = rdtsc();
+
+  if(now < p->rtdeadline)
+    return;
+  p->rtdeadline += us2tsc(p->rtperiod);
+  if(p->rtdeadline <= now)
+    p->rtdeadline = now + us2tsc(p->rtperiod);
+  p->rtbudget = p->rtruntime;
+}
+
+/**
+ * Puts real-time p, with run time left this period, on the rtq of the cpu holding
+ * its reservation, in deadline order. Called with p->lock held.
+ */
+static void rtenqueue(struct proc * p) {
+  struct cpu * c = &cpus[p->rtcpu];
+  struct proclist * q = &c->rtq;
+  struct proc * next;
+
+  p->cpuid = c->id;
+  p->onrtq = 1;
+  acquire(&c->rqlock);
+  for(next = q->head; next && next->rtdeadline <= p->rtdeadline; next = next->next)
+    ;
+  addbefore(p, next, q);
+  c->nrt++;
+  c->nrunnable++;
+  release(&c->rqlock);
+  kick(c, p);
+}
+
+/**
+ * Links RUNNABLE p into q just ahead of next, or onto the tail when next is 0.
+ * Keeps the ordered queues ordered. Called with the queue's rqlock held.
+ */
+static void addbefore(struct proc * p, struct proc * next, struct proclist * q) {
+  if(next == 0)
+    addtotail(p, q, RUNNABLE);
+  else if(next == q->head)
+    addtohead(p, q, RUNNABLE);
+  else {
+    p->next = next;
+    p->prev = next->prev;
+    next->prev->next = p;
+    next->prev = p;
+    q->count++;
+  }
+}
+
+/**
+ * Takes p, found on c's queues under c->rqlock since dropped, off c for this CPU to run.
+ * Returns 1 with p locked and dequeued, or 0 if p moved on before we got its lock.
+ */
+static int claim(struct cpu * c, struct proc * p) {
+  acquire(&p->lock);
+  if(p->state == RUNNABLE && p->cpuid == c->id &&
+      (p->onrtq ? c == cpu : (cpumask(p) & (1 << cpu->id)) != 0)) {
+    dequeue(p);
+    return 1;
+  }
+  release(&p->lock);
+  return 0;
+}
+
+/**
+ * Returns 1 if what this CPU's policy would run first outranks p, a handoff partner,
+ * so the handoff should give way to queue order. Like preempts(), only a hint.
+ */
+static int outranked(struct proc * p) {
+  struct proc * head;
+  int r;
+
+  acquire(&cpu->rqlock);
+  head = policies[cpu->policy].next(cpu, 0);
+  r = head && head != p && preempts(head, p);
+  release(&cpu->rqlock);
+  return r;
+}
+
+/**
+ * Removes and returns the real-time process with the earliest deadline on c, or failing that whatever c's
+ * policy would run first, or 0 if c has no runnable work. The process comes back locked.
+ */
+static struct proc * nextrunnable(struct cpu * c) {
+  struct proc * p;
+
+  for(;;) {
+    acquire(&c->rqlock);
+    if((p = c->rtq.head) == 0 && (p = policies[c->policy].next(c, 0)) == 0) {
+      release(&c->rqlock);
       return 0;
     }
+    release(&c->rqlock);
 
-    curr = curr->next;
+    if(claim(c, p))
+      return p;
   }
+}
 
-  for(int i = 0; i < MAX; i++) {
-    curr = ptable.pLists.runnable[i];
-    while(curr) {
-      if (curr->pid == pid) {
-        remove(curr, &ptable.pLists.runnable[i], RUNNABLE);
-        curr->prio = prio;
-        curr->budget = BUDGET;
-        addtotail(curr, &ptable.pLists.runnable[prio], RUNNABLE);
-        release(&ptable.lock);
-        return 0;
-      }
-      curr = curr->next;
+/**
+ * Returns the peer CPU with the most queued MLFQ work, or 0 if no peer has any. Real-time
+ * work stays on its reserved CPU, so it doesn't count. Reads the counts without locks,
+ * as a hint; the caller rechecks under the queue locks.
+ */
+static struct cpu * busiestcpu(void) {
+  struct cpu * c;
+  struct cpu * busiest = 0;
+  int most = 0;
+
+  for(c = cpus; c < &cpus[ncpu]; c++) {
+    if(c != cpu && c->nrunnable - c->nrt > most) {
+      most = c->nrunnable - c->nrt;
+      busiest = c;
     }
   }
+  return busiest;
+}
 
-  release(&ptable.lock);
-  return -1;
-}
\ No newline at end of file
+/**
+ * Removes and returns the best process on c's queues that may run on this CPU, or 0.
+ * Usually the one c's policy would run first; only processes pinned elsewhere are
+ * passed over. The process comes back locked.
+ */
+static struct proc * steal(struct cpu * c) {
+  struct policy * pol;
+  struct proc * p;
+
+  for(;;) {
+    acquire(&c->rqlock);
+    pol = &policies[c->policy];
+    for(p = pol->next(c, 0); p && (cpumask(p) & (1 << cpu->id)) == 0; p = pol->next(c, p))
+      ;
+    release(&c->rqlock);
+
+    if(!p || claim(c, p))
+      return p;
+  }
+}
+
+/**
+ * Returns the id of the CPU in mask with the shortest run queues, preferring
+ * this one on a tie. Used to place new processes and ones whose affinity moved.
+ */
+static int leastloaded(uint mask) {
+  struct cpu * c;
+  struct cpu * best = 0;
+
+  if(mask & (1 << cpu->id))
+    best = cpu;
+  for(c = cpus; c < &cpus[ncpu]; c++)
+    if((mask & (1 << c->id)) && (!best || c->nrunnable < best->nrunnable))
+      best = c;
+  return best ? best->id : cpu->id;
+}
+
+/**
+ * Appends p to one of its parent's child lists.
+ */
+static void addchild(struct proc * p, struct childlist * l) {
+  p->sibnext = 0;
+  p->sibprev = l->tail;
+  if(l->tail)
+    l->tail->sibnext = p;
+  else
+    l->head = p;
+  l->tail = p;
+}
+
+/**
+ * Unlinks p from one of its parent's child lists.
+ */
+static void removechild(struct proc * p, struct childlist * l) {
+  if(p->sibprev)
+    p->sibprev->sibnext = p->sibnext;
+  else
+    l->head = p->sibnext;
+  if(p->sibnext)
+    p->sibnext->sibprev = p->sibprev;
+  else
+    l->tail = p->sibprev;
+  p->sibnext = 0;
+  p->sibprev = 0;
+}
+
+/**
+ * Moves every proc on from to the tail of to, leaving from empty.
+ */
+static void splicechildren(struct childlist * from, struct childlist * to) {
+  if(!from->head)
+    return;
+  if(to->tail) {
+    to->tail->sibnext = from->head;
+    from->head->sibprev = to->tail;
+  } else
+    to->head = from->head;
+  to->tail = from->tail;
+  from->head = 0;
+  from->tail = 0;
+}
+
+/**
+ * Returns how many ticks an idle CPU can leave its timer stopped: until the
+ * earliest sleep() on ticks comes due, capped at IDLE_MAX_TICKS so idle CPUs
+ * still come back now and then to steal work. Boosts are applied lazily, so
+ * they don't need anyone awake.
+ */
+static uint idleticks(void) {
+  struct proc * p;
+  uint next = ticks + IDLE_MAX_TICKS;
+  int h = sleephash(&ticks);
+
+  acquire(&ptable.sleeplock[h]);
+  for(p = ptable.pLists.sleep[h].head; p; p = p->next)
+    if(p->chan == &ticks && p->wakeat < next)
+      next = p->wakeat;
+  release(&ptable.sleeplock[h]);
+
+  if(next <= ticks)
+    return 0;
+  if(next - ticks > IDLE_MAX_TICKS)
+    return IDLE_MAX_TICKS;
+  return next - ticks;
+}
+
+/**
+ * Round robin: one first-come, first-served queue per CPU, and every process
+ * gets the same slice, a timer tick.
+ */
+static void rrenqueue(struct cpu * c, struct proc * p) {
+  addtotail(p, &c->rrq, RUNNABLE);
+}
+
+static void rrdequeue(struct cpu * c, struct proc * p) {
+  remove(p, &c->rrq, RUNNABLE);
+}
+
+static struct proc * rrnext(struct cpu * c, struct proc * p) {
+  return p ? p->next : c->rrq.head;
+}
+
+/**
+ * MLFQ: puts p on the tail of c's queue for its priority.
+ */
+static void mlfqenqueue(struct cpu * c, struct proc * p) {
+  struct proclist * q;
+
+  syncqueues(c);
+  syncprio(p, c->epoch);
+  q = runq(c, runprio(p, c->epoch));
+  addtotail(p, q, RUNNABLE);
+  c->rqmask |= 1 << (q - c->runnable);
+}
+
+/**
+ * MLFQ: takes p off its queue. Once the queues and p are synced, runprio() names
+ * the queue p is on.
+ */
+static void mlfqdequeue(struct cpu * c, struct proc * p) {
+  struct proclist * q;
+
+  syncqueues(c);
+  syncprio(p, c->epoch);
+  q = runq(c, runprio(p, c->epoch));
+  remove(p, q, RUNNABLE);
+  if(q->count == 0)
+    c->rqmask &= ~(1 << (q - c->runnable));
+}
+
+/**
+ * MLFQ: the head of the highest priority non-empty queue comes first, then the
+ * rest of it, then the next queue down. The lowest set bit of rqmask, turned to
+ * start at qbase, names the first queue, so this never probes empty levels.
+ */
+static struct proc * mlfqnext(struct cpu * c, struct proc * p) {
+  uint mask;
+  int i;
+
+  if(p == 0)
+    syncqueues(c);
+  else if(p->next)
+    return p->next;
+  mask = ((c->rqmask >> c->qbase) | (c->rqmask << (MAX - c->qbase))) & ((1 << MAX) - 1);
+  if(p)
+    mask &= ~((2 << runprio(p, c->epoch)) - 1);
+  if(mask == 0)
+    return 0;
+  i = bsf(mask);
+  return runq(c, i)->head;
+}
+
+/**
+ * MLFQ: charges p's budget at its priority, and demotes it a level once the
+ * budget is used up. Counts the run for mlfqstat().
+ */
+static void mlfqtick(struct proc * p, uint us) {
+  struct levelcount * l;
+
+  syncprio(p, ptable.epoch);
+  l = &cpu->levels[p->prio];
+  l->dispatches++;
+  l->runus += us;
+  p->budget = p->budget - us;
+
+  if(p->budget <= 0 && p->prio != (MAX - 1)) {
+    trace(TR_DEMOTE, p, p->prio + 1);
+    l->demotions++;
+    if(p->state == RUNNABLE) {
+      dequeue(p);
+      p->prio++;
+      enqueue(p);
+    }
+    else
+      p->prio++;
+    p->budget = ptable.budget[p->prio];
+  }
+}
+
+/**
+ * MLFQ: boosting is just a new epoch. Queues and processes catch up the next
+ * time they are touched; see syncqueues() and syncprio().
+ */
+static void mlfqboost(void) {
+  ptable.epoch++;
+}
+
+static int mlfqpreempts(struct proc * p, struct proc * cur) {
+  return runprio(p, ptable.epoch) < runprio(cur, ptable.epoch);
+}
+
+/**
+ * MLFQ: the lower the priority, the longer the slice, so CPU-bound work that
+ * has sunk switches less. Anything better that wakes still preempts it.
+ */
+static uint mlfqslice(struct proc * p) {
+  return ptable.quantum[runprio(p, ptable.epoch)];
+}
+
+/**
+ * Stride: puts p on c's queue in pass order. A process that slept or comes from
+ * another CPU may be behind this CPU's virtual time; it is moved up to it, so
+ * time spent away is no credit against the others.
+ */
+static void strideenqueue(struct cpu * c, struct proc * p) {
+  struct proc * next;
+
+  if(p->pass < c->pass)
+    p->pass = c->pass;
+  for(next = c->strideq.head; next && next->pass <= p->pass; next = next->next)
+    ;
+  addbefore(p, next, &c->strideq);
+}
+
+static void stridedequeue(struct cpu * c, struct proc * p) {
+  remove(p, &c->strideq, RUNNABLE);
+}
+
+static struct proc * stridenext(struct cpu * c, struct proc * p) {
+  return p ? p->next : c->strideq.head;
+}
+
+/**
+ * Stride: each microsecond p ran moves its pass on by its stride, so twice the
+ * tickets means half the charge. This CPU's virtual time catches up to the pass
+ * p was dispatched at, which was the smallest here then. A process that yielded
+ * is queued by its old pass, so it comes off while the pass changes.
+ */
+static void stridetick(struct proc * p, uint us) {
+  int queued = p->state == RUNNABLE && !p->onrtq;
+
+  if(queued)
+    dequeue(p);
+  acquire(&cpu->rqlock);
+  if(p->pass > cpu->pass)
+    cpu->pass = p->pass;
+  release(&cpu->rqlock);
+  p->pass += (uint64)p->stride * us;
+  if(queued)
+    enqueue(p);
+}
+
+static int stridepreempts(struct proc * p, struct proc * cur) {
+  return p->pass < cur->pass;
+}
+#endif
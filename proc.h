@@ -1,6 +1,27 @@
 // Segments in proc->gdt.
 #define NSEGS     7
 
+// Doubly-linked list of procs, threaded through proc.next/prev.
+struct proclist {
+  struct proc *head;
+  struct proc *tail;
+  int count;
+};
+
+// A process's children, threaded through proc.sibnext/sibprev.
+struct childlist {
+  struct proc *head;
+  struct proc *tail;
+};
+
+// What the MLFQ did at one priority on one cpu. Only that cpu
+// writes them, from sched() with interrupts off.
+struct levelcount {
+  uint dispatches;             // Runs at this priority, each ending in sched()
+  uint demotions;              // Runs that used up the budget here
+  uint64 runus;                // Microseconds run at this priority
+};
+
 // Per-CPU state
 struct cpu {
   uchar id;                    // Local APIC ID; index into cpus[] below
@@ -10,7 +31,35 @@ struct cpu {
   volatile uint started;       // Has the CPU started?
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
-  
+  struct spinlock rqlock;      // Protects runnable[] through nrunnable
+  struct proclist runnable[MAX]; // This cpu's MLFQ run queues, as a ring
+  uint qbase;                  // Index in runnable[] of priority 0
+  uint epoch;                  // Boost epoch the ring was last rotated to
+  uint rqmask;                 // Bit i set when runnable[i] is non-empty
+  int nrunnable;               // Number of procs on runnable[]
+  int idle;                    // Nothing to run; tick may be stopped
+  volatile uint kicked;        // Sent a reschedule IPI since going idle
+  volatile uint needresched;   // A better process is queued; yield at trap exit
+  struct proclist rtq;         // Real-time procs, earliest deadline first
+  int nrt;                     // Number of procs on rtq, also in nrunnable
+  uint rtutil;                 // Real-time reservations here, permille
+  struct proclist strideq;     // Stride-scheduled procs, smallest pass first
+  uint64 pass;                 // Virtual time: pass of the last proc dispatched
+  struct proclist rrq;         // Round-robin procs, first come first served
+  int policy;                  // Policy new work here is queued under
+  struct proc *handoff;        // Run this next if still queued here; see handoff()
+  uint handoffticks;           // Slice ticks its donor had used, for it to finish
+  char *kstacks[NKSTACKCACHE]; // Free kernel stacks for allocproc()
+  int nkstacks;
+  pde_t *pgdirs[NPGDIRCACHE];  // Free page tables for setupkvm()
+  int npgdirs;
+  uint kstackhit;              // Kernel stacks handed out from kstacks[]
+  uint kstackmiss;             // ... and from kalloc()
+  uint pgdirhit;               // Page tables handed out from pgdirs[]
+  uint pgdirmiss;              // ... and built from scratch
+  struct levelcount levels[MAX]; // MLFQ counters by priority, for mlfqstat()
+  uint switches;               // Processes dispatched here, under any policy
+
   // Cpu-local storage variables; see below
   struct cpu *cpu;
   struct proc *proc;           // The currently-running process.
@@ -53,6 +102,7 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
+  struct spinlock lock;        // See the locking notes in proc.c
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
@@ -63,6 +113,7 @@ struct proc {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
+  int xstatus;                 // Exit status, for the parent's waitpid()
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
@@ -70,12 +121,39 @@ struct proc {
   uint start_ticks;
   uint uid;
   uint gid;
-  uint cpu_ticks_total;
-  uint cpu_ticks_in;
+  uint64 cpu_cycles_total;     // TSC cycles spent running
+  uint64 cpu_cycles_in;        // TSC when last dispatched
+  uint sliceticks;             // Timer ticks since dispatched; see sliceover()
   int prio;
-  int budget;
+  int budget;                  // Microseconds left at this priority
+  int inherit;                 // Priority lent by a waiter on a lock we hold; MAX if none
+  int nlocks;                  // Sleep locks and buffers held; see droplock()
+  uint epoch;                  // Boost epoch prio and budget are current for
+  uint affinity;               // Cpus we may run on, bit per cpu id
+  volatile uint seq;           // Odd while pid or name change; see procsnap()
+  int cpuid;                   // Cpu whose run queue holds (or last held) us
+  uint wakeat;                 // Tick a sleep() on ticks is waiting for
+  struct waitq *waitq;         // Wait queue we are in line on, if any
+  struct proc *wqnext;         // Next in line on that queue
+  uint rtperiod;               // Real-time period in us; 0 if not real-time
+  uint rtruntime;              // Real-time run time per period, in us
+  int rtbudget;                // Real-time run time left this period, in us
+  uint64 rtdeadline;           // TSC at the end of the current period
+  int rtcpu;                   // Cpu holding our real-time reservation
+  int onrtq;                   // Queued on cpus[cpuid].rtq, not the MLFQ
+  int rtran;                   // Last dispatched from an rtq
+  int tickets;                 // Share of the CPU under the stride policy
+  uint stride;                 // STRIDE1 / tickets
+  uint64 pass;                 // Stride charged so far; smallest runs first
+  int policy;                  // Policy whose queues we were last put on
 
   struct proc * next;
+  struct proc * prev;
+  struct proc * pidnext;       // Next proc in the same PID hash bucket
+  struct childlist children;   // Live children
+  struct childlist zombies;    // Exited children not yet reaped
+  struct proc * sibnext;       // Links on the parent's children or zombies
+  struct proc * sibprev;
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -1,30 +1,43 @@
 #include "types.h"
 #include "user.h"
+#include "param.h"
 #include "uproc.h"
 
+static char * states[] = {
+	[PS_UNUSED]   "unused",
+	[PS_EMBRYO]   "embryo",
+	[PS_SLEEPING] "sleep",
+	[PS_RUNNABLE] "runble",
+	[PS_RUNNING]  "run",
+	[PS_ZOMBIE]   "zombie",
+};
 
 int
 main(int argc, char *argv[])
 {
 	int max = 16;
+	int cursor = 0;
+	int num;
 
-	struct uproc * u = malloc(max * sizeof(struct uproc));
+	struct procsnap * u = malloc(max * sizeof(struct procsnap));
 
-	int num = getprocs(max, u);
+	printf(1,"PID 	Name 	UID 	GID 	Parent ID 	Prio 	Tix 	Pass 	Elapsed   CPU	State 	Size 	CPUs\n");
 
-	if(num < 0)
-		printf(1, "Error, try again.");
-	else
+	// Page through the table max records at a time until the cursor runs off the end.
+	while(cursor >= 0)
 	{
-
-		printf(1,"PID 	Name 	UID 	GID 	Parent ID 	Prio 	Elapsed   CPU	State 	Size\n");
+		num = procsnap(&cursor, u, max);
+		if(num < 0)
+		{
+			printf(1, "Error, try again.\n");
+			break;
+		}
 
 		for(int i = 0; i < num; i++)
 		{
-			printf(1,"%d 	%s 	%d 	%d 	%d 		%d	%d.%d%d 	  %d.%d%d 	%s 	%d\n", u[i].pid, u[i].name, u[i].uid, u[i].gid, u[i].ppid, u[i].prio, (u[i].elapsed_ticks/100), ((u[i].elapsed_ticks%100)/10), (u[i].elapsed_ticks%10), (u[i].CPU_total_ticks/100), ((u[i].CPU_total_ticks%100)/10), (u[i].CPU_total_ticks%10), u[i].state, u[i].size);
+			printf(1,"%d 	%s 	%d 	%d 	%d 		%d	%d 	%d 	%d.%d%d 	  %d.%d%d%d%d%d%d 	%s 	%d 	%x\n", u[i].pid, u[i].name, u[i].uid, u[i].gid, u[i].ppid, u[i].prio, u[i].tickets, u[i].pass, (u[i].elapsed_ticks/100), ((u[i].elapsed_ticks%100)/10), (u[i].elapsed_ticks%10), u[i].CPU_total_secs, (u[i].CPU_total_usecs/100000), (u[i].CPU_total_usecs/10000%10), (u[i].CPU_total_usecs/1000%10), (u[i].CPU_total_usecs/100%10), (u[i].CPU_total_usecs/10%10), (u[i].CPU_total_usecs%10), states[u[i].state], u[i].size, u[i].affinity);
 		}
 	}
 
 	exit();
 }
-	
\ No newline at end of file
@@ -0,0 +1,492 @@
+// Measure how well the scheduler does, not just whether it works.
+//   schedbench             run every test
+//   schedbench test ...    run the named tests only
+//
+// Tests: latency pingpong fairness starvation forkexit throughput stride.
+// Every result is one line of "test key=value ..." with times in
+// microseconds, so runs before and after tuning the MLFQ (see mlfq)
+// or under another policy (see policy) can be compared with grep
+// and diff. Lines
+// starting with '#' are comments.
+
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "date.h"
+#include "uproc.h"
+
+#define NLAT      50       // wakeups timed per latency run
+#define NPING     1000     // round trips in pingpong
+#define FAIRUS    1000000  // how long each fairness run spins
+#define STARVEMAX 3000     // ticks before starvation gives up
+#define NFORK     200      // serial fork/exit/wait cycles
+#define NBURST    64       // children forked at once
+#define NSTORM    50       // fork/exit/wait cycles per cpu, all cpus at once
+#define NTIX      2        // processes sharing a cpu in stride
+
+static int ncpu;
+static int tix[NTIX] = { 70, 30 };  // tickets each stride process gets
+static volatile uint sink;
+
+static uint
+now(void)
+{
+  struct timeval tv;
+
+  getuptime(&tv);
+  return tv.sec * 1000000 + tv.usec;
+}
+
+static void
+work(uint n)
+{
+  while(n-- > 0)
+    sink++;
+}
+
+// Start n children that spin until killed.
+static void
+starthogs(int n, int *pids)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if((pids[i] = fork()) == 0)
+      for(;;)
+        sink++;
+    if(pids[i] < 0){
+      printf(2, "schedbench: fork failed\n");
+      exit();
+    }
+  }
+}
+
+static void
+stophogs(int n, int *pids)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    kill(pids[i]);
+  for(i = 0; i < n; i++)
+    wait();
+}
+
+// Time from the write that wakes a reader blocked on a pipe to the
+// reader running, with load spinning hogs competing for the cpus.
+static void
+latency(int load)
+{
+  int req[2], rep[2], hogs[NCPU * 2];
+  uint t, lat, min, max, sum;
+  int i;
+
+  pipe(req);
+  pipe(rep);
+  if(fork() == 0){
+    close(req[1]);
+    close(rep[0]);
+    while(read(req[0], &t, sizeof(t)) == sizeof(t)){
+      lat = now() - t;
+      write(rep[1], &lat, sizeof(lat));
+    }
+    exit();
+  }
+  close(req[0]);
+  close(rep[1]);
+  starthogs(load, hogs);
+
+  min = ~0;
+  max = sum = 0;
+  for(i = 0; i < NLAT; i++){
+    // Give the reader time to block again before waking it.
+    sleep(1);
+    t = now();
+    write(req[1], &t, sizeof(t));
+    read(rep[0], &lat, sizeof(lat));
+    if(lat < min)
+      min = lat;
+    if(lat > max)
+      max = lat;
+    sum += lat;
+  }
+
+  close(req[1]);
+  close(rep[0]);
+  wait();
+  stophogs(load, hogs);
+  printf(1, "latency load=%d n=%d min_us=%d avg_us=%d max_us=%d\n",
+    load, NLAT, min, sum / NLAT, max);
+}
+
+// One byte bounced between two processes; each round trip is two
+// context switches plus two pipe reads and writes.
+static void
+pingpong(void)
+{
+  int ab[2], ba[2];
+  uint t;
+  char c = 0;
+  int i;
+
+  pipe(ab);
+  pipe(ba);
+  if(fork() == 0){
+    close(ab[1]);
+    close(ba[0]);
+    while(read(ab[0], &c, 1) == 1)
+      write(ba[1], &c, 1);
+    exit();
+  }
+  close(ab[0]);
+  close(ba[1]);
+
+  t = now();
+  for(i = 0; i < NPING; i++){
+    write(ab[1], &c, 1);
+    read(ba[0], &c, 1);
+  }
+  t = now() - t;
+
+  close(ab[1]);
+  close(ba[0]);
+  wait();
+  printf(1, "pingpong n=%d total_us=%d switch_ns=%d\n",
+    NPING, t, t * 500 / NPING);
+}
+
+// n CPU-bound processes, all started at prio, count loop iterations
+// for the same stretch of wall time. Shares are in thousandths of the
+// total and jain is Jain's fairness index times 1000: 1000 when every
+// share is equal, 1000/n when one process got everything.
+static void
+fairness(int prio, int n)
+{
+  int fd[2];
+  uint start, end, cnt[NCPU * 2];
+  uint total, share, min, max, s, ss;
+  int i;
+
+  pipe(fd);
+  start = now() + 20000;
+  end = start + FAIRUS;
+  for(i = 0; i < n; i++){
+    if(fork() == 0){
+      close(fd[0]);
+      setpriority(getpid(), prio);
+      while((int)(now() - start) < 0)
+        ;
+      cnt[0] = 0;
+      while((int)(now() - end) < 0)
+        cnt[0]++;
+      write(fd[1], &cnt[0], sizeof(cnt[0]));
+      exit();
+    }
+  }
+  close(fd[1]);
+  for(i = 0; i < n; i++)
+    if(read(fd[0], &cnt[i], sizeof(cnt[i])) != sizeof(cnt[i]))
+      cnt[i] = 0;
+  close(fd[0]);
+  for(i = 0; i < n; i++)
+    wait();
+
+  total = 0;
+  for(i = 0; i < n; i++)
+    total += cnt[i];
+  if(total < 1000)
+    total = 1000;
+  min = ~0;
+  max = s = ss = 0;
+  for(i = 0; i < n; i++){
+    share = cnt[i] / (total / 1000);
+    if(share < min)
+      min = share;
+    if(share > max)
+      max = share;
+    s += share;
+    ss += share * share;
+  }
+  printf(1, "fairness prio=%d n=%d min_share=%d max_share=%d jain=%d\n",
+    prio, n, min, max, ss ? s * s * 1000 / (n * ss) : 0);
+}
+
+// A process at the lowest priority wakes up behind n hogs that start
+// at priority 0, and we time how long it waits for the cpu. Only
+// priority boosts every boost interval can get it there. A watchdog
+// reports ~0 after STARVEMAX ticks if it never runs.
+static void
+starvation(int n)
+{
+  int fd[2], hogs[NCPU * 2];
+  int victim, dog;
+  uint t, waited;
+
+  pipe(fd);
+  starthogs(n, hogs);
+  if((victim = fork()) == 0){
+    close(fd[0]);
+    setpriority(getpid(), MAX - 1);
+    t = now();
+    sleep(1);
+    waited = now() - t;
+    write(fd[1], &waited, sizeof(waited));
+    exit();
+  }
+  if((dog = fork()) == 0){
+    close(fd[0]);
+    sleep(STARVEMAX);
+    waited = ~0;
+    write(fd[1], &waited, sizeof(waited));
+    exit();
+  }
+  close(fd[1]);
+  read(fd[0], &waited, sizeof(waited));
+  close(fd[0]);
+
+  kill(victim);
+  kill(dog);
+  wait();
+  wait();
+  stophogs(n, hogs);
+  if(waited == ~0)
+    printf(1, "starvation hogs=%d prio=%d wait_us=-1 timeout_ticks=%d\n",
+      n, MAX - 1, STARVEMAX);
+  else
+    printf(1, "starvation hogs=%d prio=%d wait_us=%d\n", n, MAX - 1, waited);
+}
+
+// The cost of a process's whole life: one at a time, then NBURST
+// children alive at once, then a forker on every cpu at once. Also
+// the time cpus spent spinning on the process table's locks over
+// all three, from lockstat(), in total and lock by lock.
+static void
+forkexit(void)
+{
+  struct lockstat before[NLOCKSTAT], after[NLOCKSTAT];
+  uint t, serial, burst, storm, spins, spinus;
+  int i, j, n, nlock;
+
+  nlock = lockstat(before, NLOCKSTAT);
+  t = now();
+  for(i = 0; i < NFORK; i++){
+    if(fork() == 0)
+      exit();
+    wait();
+  }
+  serial = (now() - t) / NFORK;
+
+  t = now();
+  for(n = 0; n < NBURST; n++){
+    i = fork();
+    if(i == 0)
+      exit();
+    if(i < 0)
+      break;
+  }
+  for(i = 0; i < n; i++)
+    wait();
+  burst = n ? (now() - t) / n : 0;
+
+  t = now();
+  for(i = 0; i < ncpu; i++){
+    if(fork() == 0){
+      for(j = 0; j < NSTORM; j++){
+        if(fork() == 0)
+          exit();
+        wait();
+      }
+      exit();
+    }
+  }
+  for(i = 0; i < ncpu; i++)
+    wait();
+  storm = (now() - t) / NSTORM;
+
+  if(lockstat(after, NLOCKSTAT) != nlock)
+    nlock = 0;
+  spins = spinus = 0;
+  for(i = 0; i < nlock; i++){
+    printf(1, "# forkexit lock=%s spins=%d spin_us=%d\n", after[i].name,
+      after[i].spins - before[i].spins, after[i].spinus - before[i].spinus);
+    spins += after[i].spins - before[i].spins;
+    spinus += after[i].spinus - before[i].spinus;
+  }
+
+  printf(1, "forkexit n=%d cycle_us=%d burst=%d burst_us=%d storm=%d storm_us=%d spins=%d spin_us=%d\n",
+    NFORK, serial, n, burst, ncpu, storm, spins, spinus);
+}
+
+// Iterations of work() that take about us microseconds here.
+static uint
+calibrate(uint us)
+{
+  uint n, t;
+
+  for(n = 1000; ; n *= 2){
+    t = now();
+    work(n);
+    t = now() - t;
+    if(t >= us / 4)
+      return n / (t / 1000 + 1) * (us / 1000);
+  }
+}
+
+// The same total work spread over 2 * ncpu processes, allowed on the
+// first k cpus, for k from 1 to ncpu. speedup is the one-cpu time
+// over the k-cpu time, times 1000.
+static void
+throughput(void)
+{
+  uint per, t, t1, mask;
+  int k, i, n;
+
+  n = 2 * ncpu;
+  per = calibrate(1000000) / n;
+  mask = getaffinity(getpid());
+  t1 = 0;
+  for(k = 1; k <= ncpu; k++){
+    setaffinity(getpid(), (1 << k) - 1);
+    t = now();
+    for(i = 0; i < n; i++)
+      if(fork() == 0){
+        work(per);
+        exit();
+      }
+    for(i = 0; i < n; i++)
+      wait();
+    t = now() - t;
+    if(k == 1)
+      t1 = t;
+    printf(1, "throughput cpus=%d procs=%d elapsed_us=%d speedup=%d\n",
+      k, n, t, t1 / (t / 1000 + 1));
+  }
+  setaffinity(getpid(), mask);
+}
+
+// NTIX CPU-bound processes pinned to one cpu, holding tix[] tickets,
+// count loop iterations for us microseconds of wall time as in
+// fairness. Shares are in thousandths of the total; want is what the
+// tickets call for and err is the largest miss. Under the stride
+// policy err shrinks as the run gets longer. The other policies
+// ignore tickets, so there the shares come out even.
+static void
+stride(uint us)
+{
+  int fd[2], i;
+  uint start, end, cnt[NTIX], rec[2], total, alltix, share, want, err;
+  uint mask = getaffinity(getpid());
+
+  pipe(fd);
+  setaffinity(getpid(), 1);
+  start = now() + 20000;
+  end = start + us;
+  for(i = 0; i < NTIX; i++){
+    if(fork() == 0){
+      close(fd[0]);
+      if(settickets(getpid(), tix[i]) < 0)
+        printf(2, "schedbench: settickets failed\n");
+      while((int)(now() - start) < 0)
+        ;
+      rec[0] = i;
+      rec[1] = 0;
+      while((int)(now() - end) < 0)
+        rec[1]++;
+      write(fd[1], rec, sizeof(rec));
+      exit();
+    }
+  }
+  setaffinity(getpid(), mask);
+  close(fd[1]);
+  for(i = 0; i < NTIX; i++)
+    cnt[i] = 0;
+  for(i = 0; i < NTIX; i++)
+    if(read(fd[0], rec, sizeof(rec)) == sizeof(rec) && rec[0] < NTIX)
+      cnt[rec[0]] = rec[1];
+  close(fd[0]);
+  for(i = 0; i < NTIX; i++)
+    wait();
+
+  total = alltix = 0;
+  for(i = 0; i < NTIX; i++){
+    total += cnt[i];
+    alltix += tix[i];
+  }
+  if(total < 1000)
+    total = 1000;
+  err = 0;
+  for(i = 0; i < NTIX; i++){
+    share = cnt[i] / (total / 1000);
+    want = tix[i] * 1000 / alltix;
+    if(share > want && share - want > err)
+      err = share - want;
+    if(share < want && want - share > err)
+      err = want - share;
+    printf(1, "stride run_us=%d tickets=%d want=%d share=%d\n",
+      us, tix[i], want, share);
+  }
+  printf(1, "stride run_us=%d n=%d err=%d\n", us, NTIX, err);
+}
+
+// setaffinity() refuses a mask with no online cpu in it.
+static int
+countcpus(void)
+{
+  uint mask = getaffinity(getpid());
+  int n;
+
+  for(n = 1; n < NCPU && setaffinity(getpid(), 1 << n) == 0; n++)
+    ;
+  setaffinity(getpid(), mask);
+  return n;
+}
+
+static int
+want(int argc, char *argv[], char *name)
+{
+  int i;
+
+  if(argc < 2)
+    return 1;
+  for(i = 1; i < argc; i++)
+    if(strcmp(argv[i], name) == 0)
+      return 1;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct mlfqstat st;
+  int prio;
+
+  ncpu = countcpus();
+  mlfqstat(&st);
+  printf(1, "# schedbench ncpu=%d policy=%d MAX=%d boost=%d",
+    ncpu, setpolicy(-1), MAX, st.boost);
+  for(prio = 0; prio < MAX; prio++)
+    printf(1, " q%d=%d/%d", prio, st.level[prio].quantum, st.level[prio].budget);
+  printf(1, "\n");
+
+  if(want(argc, argv, "latency")){
+    latency(0);
+    latency(ncpu);
+  }
+  if(want(argc, argv, "pingpong"))
+    pingpong();
+  if(want(argc, argv, "fairness"))
+    for(prio = 0; prio < MAX; prio++)
+      fairness(prio, 2 * ncpu);
+  if(want(argc, argv, "starvation"))
+    starvation(ncpu);
+  if(want(argc, argv, "forkexit"))
+    forkexit();
+  if(want(argc, argv, "throughput"))
+    throughput();
+  if(want(argc, argv, "stride")){
+    stride(FAIRUS / 10);
+    stride(FAIRUS);
+    stride(FAIRUS * 5);
+  }
+  exit();
+}
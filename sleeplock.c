@@ -0,0 +1,59 @@
+// Sleeping locks, handed over in FIFO order.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+
+void
+initsleeplock(struct sleeplock *lk, char *name)
+{
+  initlock(&lk->lk, "sleep lock");
+  lk->name = name;
+  lk->locked = 0;
+  lk->owner = 0;
+}
+
+void
+acquiresleep(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->locked){
+    // releasesleep() makes us the owner before it wakes us.
+    while(lk->owner != proc){
+      lendprio(lk->owner);
+      wqsleep(&lk->wq, &lk->lk);
+    }
+  } else {
+    lk->locked = 1;
+    lk->owner = proc;
+  }
+  release(&lk->lk);
+  holdlock();
+}
+
+void
+releasesleep(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if((lk->owner = wqwake(&lk->wq)) == 0)
+    lk->locked = 0;
+  release(&lk->lk);
+  droplock();
+}
+
+int
+holdingsleep(struct sleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = lk->locked && lk->owner == proc;
+  release(&lk->lk);
+  return r;
+}
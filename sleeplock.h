@@ -0,0 +1,20 @@
+// Processes waiting for something, woken one at a time in the order
+// they arrived. The waiters and the waker must hold the spinlock that
+// guards whatever is being waited for; see wqsleep() and wqwake().
+struct waitq {
+  struct proc *head;
+  struct proc *tail;
+};
+
+// Long-term lock for processes. Waiters sleep rather than spin, and
+// releasing hands the lock straight to the longest waiter, so only
+// that one wakes and no newcomer can cut in ahead of it.
+struct sleeplock {
+  uint locked;        // Is the lock held?
+  struct spinlock lk; // Guards this sleep lock
+  struct waitq wq;    // Processes waiting for it, oldest first
+  struct proc *owner; // Process holding the lock
+
+  // For debugging:
+  char *name;         // Name of lock.
+};
@@ -6,8 +6,8 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 
 void
 initlock(struct spinlock *lk, char *name)
@@ -15,6 +15,8 @@ initlock(struct spinlock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->nspin = 0;
+  lk->spincycles = 0;
 }
 
 // Acquire the lock.
@@ -24,15 +26,23 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 t;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
   // The xchg is atomic.
   // It also serializes, so that reads after acquire are not
-  // reordered before it. 
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // reordered before it. Time spent spinning is charged to
+  // the lock once we hold it.
+  if(xchg(&lk->locked, 1) != 0){
+    t = rdtsc();
+    while(xchg(&lk->locked, 1) != 0)
+      ;
+    lk->nspin++;
+    lk->spincycles += rdtsc() - t;
+  }
 
   // Record info about lock acquisition for debugging.
   lk->cpu = cpu;
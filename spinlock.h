@@ -7,5 +7,9 @@ struct spinlock {
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+
+  // Contention, updated by each holder; see lockstat().
+  uint nspin;        // Acquires that found it held
+  uint64 spincycles; // TSC cycles spent waiting for it
 };
 
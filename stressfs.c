@@ -6,32 +6,76 @@
 // after about 5 runs of stressfs in QEMU on a 2.1GHz CPU:
 //    for (i = 0; i < 40000; i++)
 //      asm volatile("");
+//
+// Also a many-writers load on the buffer cache, inode locks and log:
+//   stressfs [procs [blocks]]
+// runs procs writers (default 5) of blocks blocks each (default 20)
+// and reports context switches per block read or written, counted
+// under any scheduling policy. Fewer switches per op mean fewer
+// waiters woken only to go back to sleep. Given arguments, it
+// deletes its files when done so runs can be repeated.
 
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "param.h"
+#include "uproc.h"
+#include "date.h"
 #include "fs.h"
 #include "fcntl.h"
 
+#define MAXPROCS 32
+
+static uint
+switches(void)
+{
+  struct mlfqstat st;
+
+  if(mlfqstat(&st) < 0)
+    return 0;
+  return st.switches;
+}
+
+static uint
+now(void)
+{
+  struct timeval tv;
+
+  getuptime(&tv);
+  return tv.sec * 1000000 + tv.usec;
+}
+
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int fd, i, me, procs = 5, blocks = 20;
   char path[] = "stressfs0";
   char data[512];
+  uint t, sw, ops;
+
+  if(argc > 1)
+    procs = atoi(argv[1]);
+  if(argc > 2)
+    blocks = atoi(argv[2]);
+  if(procs < 1 || procs > MAXPROCS || blocks < 1){
+    printf(2, "usage: stressfs [procs (1-%d) [blocks]]\n", MAXPROCS);
+    exit();
+  }
 
   printf(1, "stressfs starting\n");
   memset(data, 'a', sizeof(data));
+  t = now();
+  sw = switches();
 
-  for(i = 0; i < 4; i++)
+  for(me = 0; me < procs - 1; me++)
     if(fork() > 0)
       break;
 
-  printf(1, "write %d\n", i);
+  printf(1, "write %d\n", me);
 
-  path[8] += i;
+  path[8] += me;
   fd = open(path, O_CREATE | O_RDWR);
-  for(i = 0; i < 20; i++)
+  for(i = 0; i < blocks; i++)
 //    printf(fd, "%d\n", i);
     write(fd, data, sizeof(data));
   close(fd);
@@ -39,11 +83,22 @@ main(int argc, char *argv[])
   printf(1, "read\n");
 
   fd = open(path, O_RDONLY);
-  for (i = 0; i < 20; i++)
+  for (i = 0; i < blocks; i++)
     read(fd, data, sizeof(data));
   close(fd);
+  if(argc > 1)
+    unlink(path);
 
   wait();
-  
+
+  // Each process waits for the one it forked, so the first is last.
+  if(me == 0){
+    t = now() - t;
+    sw = switches() - sw;
+    ops = 2 * procs * blocks;
+    printf(1, "stressfs procs=%d blocks=%d elapsed_us=%d ops=%d switches=%d switches_per_kop=%d\n",
+      procs, blocks, t, ops, sw, sw * 1000 / ops);
+  }
+
   exit();
 }
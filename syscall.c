@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
@@ -113,6 +114,22 @@ extern int sys_chmod(void);
 extern int sys_chown(void);
 extern int sys_chgrp(void);
 #endif
+extern int sys_getuptime(void);
+extern int sys_setaffinity(void);
+extern int sys_getaffinity(void);
+extern int sys_isolcpus(void);
+extern int sys_schedtrace(void);
+extern int sys_procsnap(void);
+extern int sys_setrealtime(void);
+extern int sys_yield_to(void);
+extern int sys_waitpid(void);
+extern int sys_exitstatus(void);
+extern int sys_settickets(void);
+extern int sys_setpolicy(void);
+extern int sys_setboost(void);
+extern int sys_setquantum(void);
+extern int sys_mlfqstat(void);
+extern int sys_lockstat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -150,6 +167,22 @@ static int (*syscalls[])(void) = {
 [SYS_chown]   sys_chown,
 [SYS_chgrp]   sys_chgrp,
 #endif
+[SYS_getuptime] sys_getuptime,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_getaffinity] sys_getaffinity,
+[SYS_isolcpus] sys_isolcpus,
+[SYS_schedtrace] sys_schedtrace,
+[SYS_procsnap] sys_procsnap,
+[SYS_setrealtime] sys_setrealtime,
+[SYS_yield_to] sys_yield_to,
+[SYS_waitpid] sys_waitpid,
+[SYS_exitstatus] sys_exitstatus,
+[SYS_settickets] sys_settickets,
+[SYS_setpolicy] sys_setpolicy,
+[SYS_setboost] sys_setboost,
+[SYS_setquantum] sys_setquantum,
+[SYS_mlfqstat] sys_mlfqstat,
+[SYS_lockstat] sys_lockstat,
 };
 
 // put data structure for printing out system call invocation information here
@@ -193,6 +226,22 @@ static char * syscallnames[] = {
 [SYS_chown]"chown",
 [SYS_chgrp]"chgrp",
 #endif
+[SYS_getuptime]"getuptime",
+[SYS_setaffinity]"setaffinity",
+[SYS_getaffinity]"getaffinity",
+[SYS_isolcpus]"isolcpus",
+[SYS_schedtrace]"schedtrace",
+[SYS_procsnap]"procsnap",
+[SYS_setrealtime]"setrealtime",
+[SYS_yield_to]"yield_to",
+[SYS_waitpid]"waitpid",
+[SYS_exitstatus]"exitstatus",
+[SYS_settickets]"settickets",
+[SYS_setpolicy]"setpolicy",
+[SYS_setboost]"setboost",
+[SYS_setquantum]"setquantum",
+[SYS_mlfqstat]"mlfqstat",
+[SYS_lockstat]"lockstat",
 };
 
 #endif
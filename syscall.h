@@ -33,4 +33,20 @@
 #define SYS_setpriority SYS_getprocs+1
 #define SYS_chmod	SYS_setpriority+1
 #define SYS_chown	SYS_chmod+1
-#define SYS_chgrp	SYS_chown+1
\ No newline at end of file
+#define SYS_chgrp	SYS_chown+1
+#define SYS_getuptime	SYS_chgrp+1
+#define SYS_setaffinity	SYS_getuptime+1
+#define SYS_getaffinity	SYS_setaffinity+1
+#define SYS_isolcpus	SYS_getaffinity+1
+#define SYS_schedtrace	SYS_isolcpus+1
+#define SYS_procsnap	SYS_schedtrace+1
+#define SYS_setrealtime	SYS_procsnap+1
+#define SYS_yield_to	SYS_setrealtime+1
+#define SYS_waitpid	SYS_yield_to+1
+#define SYS_exitstatus	SYS_waitpid+1
+#define SYS_settickets	SYS_exitstatus+1
+#define SYS_setpolicy	SYS_settickets+1
+#define SYS_setboost	SYS_setpolicy+1
+#define SYS_setquantum	SYS_setboost+1
+#define SYS_mlfqstat	SYS_setquantum+1
+#define SYS_lockstat	SYS_mlfqstat+1
\ No newline at end of file
@@ -5,8 +5,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "uproc.h"
+#include "trace.h"
 
 int
 sys_fork(void)
@@ -17,7 +19,7 @@ sys_fork(void)
 int
 sys_exit(void)
 {
-  exit();
+  exit(0);
   return 0;  // not reached
 }
 
@@ -66,6 +68,7 @@ sys_sleep(void)
   if(argint(0, &n) < 0)
     return -1;
   ticks0 = ticks;
+  proc->wakeat = ticks0 + n;  // lets idle CPUs stop their tick until then
   while(ticks - ticks0 < n){
     if(proc->killed){
       return -1;
@@ -109,6 +112,20 @@ sys_date(void) //P1
   return 0;
 }
 
+/**
+ * Fills in the time since boot to the microsecond, from the TSC.
+ */
+int
+sys_getuptime(void)
+{
+  struct timeval *tv;
+
+  if(argptr(0, (void*) &tv, sizeof(*tv)) < 0)
+    return -1;
+  uptimeus(tv);
+  return 0;
+}
+
 /** 
  * [Eli] Returns UID of process.
  */
@@ -194,6 +211,190 @@ int sys_setpriority(void)
     return -1;
   if((priority < 0) || (priority > MAX - 1))
     return -1;
-  proc->prio = priority;
   return setprio(pid, priority);
-}
\ No newline at end of file
+}
+
+int sys_setaffinity(void)
+{
+  int pid;
+  int mask;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+int sys_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getaffinity(pid);
+}
+
+int sys_isolcpus(void)
+{
+  int mask;
+
+  if(argint(0, &mask) < 0)
+    return -1;
+  return isolcpus(mask);
+}
+
+int sys_schedtrace(void)
+{
+  int max;
+  struct traceevent * buf;
+
+  if(argint(1, &max) < 0 || max <= 0)
+    return -1;
+  if(max > NCPU * NTRACE)
+    max = NCPU * NTRACE;
+  if(argptr(0, (void*) &buf, max * sizeof(*buf)) < 0)
+    return -1;
+  return tracedrain(buf, max);
+}
+
+/**
+ * Fills in up to max process records starting at table slot *cursor, and
+ * moves *cursor past them, to -1 once the whole table has been seen.
+ */
+int sys_procsnap(void)
+{
+  int * cursor;
+  int max;
+  struct procsnap * buf;
+
+  if(argptr(0, (void*) &cursor, sizeof(*cursor)) < 0)
+    return -1;
+  if(argint(2, &max) < 0 || max <= 0)
+    return -1;
+  if(max > PGSIZE / sizeof(*buf))
+    max = PGSIZE / sizeof(*buf);
+  if(argptr(1, (void*) &buf, max * sizeof(*buf)) < 0)
+    return -1;
+  return procsnap(cursor, buf, max);
+}
+
+int sys_setrealtime(void)
+{
+  int pid;
+  int period;
+  int runtime;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argint(1, &period) < 0)
+    return -1;
+  if(argint(2, &runtime) < 0)
+    return -1;
+  return setrealtime(pid, period, runtime);
+}
+
+int sys_yield_to(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return yieldto(pid);
+}
+
+int sys_waitpid(void)
+{
+  int pid;
+  int addr;
+  int options;
+  int * status = 0;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argint(1, &addr) < 0)
+    return -1;
+  if(addr && argptr(1, (void*) &status, sizeof(*status)) < 0)
+    return -1;
+  if(argint(2, &options) < 0)
+    return -1;
+  return waitpid(pid, status, options);
+}
+
+int sys_exitstatus(void)
+{
+  int status;
+
+  if(argint(0, &status) < 0)
+    return -1;
+  exit(status);
+  return 0;  // not reached
+}
+
+int sys_settickets(void)
+{
+  int pid;
+  int tickets;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argint(1, &tickets) < 0)
+    return -1;
+  return settickets(pid, tickets);
+}
+
+int sys_setpolicy(void)
+{
+  int policy;
+
+  if(argint(0, &policy) < 0)
+    return -1;
+  return setpolicy(policy);
+}
+
+int sys_setboost(void)
+{
+  int ticks;
+
+  if(argint(0, &ticks) < 0)
+    return -1;
+  return setboost(ticks);
+}
+
+int sys_setquantum(void)
+{
+  int prio;
+  int quantum;
+  int budget;
+
+  if(argint(0, &prio) < 0)
+    return -1;
+  if(argint(1, &quantum) < 0)
+    return -1;
+  if(argint(2, &budget) < 0)
+    return -1;
+  return setquantum(prio, quantum, budget);
+}
+
+int sys_mlfqstat(void)
+{
+  struct mlfqstat * st;
+
+  if(argptr(0, (void*) &st, sizeof(*st)) < 0)
+    return -1;
+  return mlfqstat(st);
+}
+
+int sys_lockstat(void)
+{
+  struct lockstat * ls;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NLOCKSTAT)
+    n = NLOCKSTAT;
+  if(argptr(0, (void*) &ls, n * sizeof(*ls)) < 0)
+    return -1;
+  return lockstat(ls, n);
+}
@@ -1,5 +1,6 @@
 #include "types.h"
 #include "user.h"
+#include "date.h"
 
 
 /**
@@ -9,14 +10,15 @@
  */
 int time(char * argv[])
 {
-	int time_in;
-	int time_out;
-	int time_total;
+	struct timeval time_in;
+	struct timeval time_out;
+	uint secs;
+	uint usecs;
 	int pid = getpid();
 	char* name = argv[0];
 	int check = 0;
 
-	time_in = uptime();
+	getuptime(&time_in);
 	fork();
 	// Child branch from fork. Run inputted console command.
 	if(pid != getpid())
@@ -29,11 +31,16 @@ int time(char * argv[])
 	if(pid == getpid() && check == 0)
 	{
 		wait();
-		time_out = uptime();
-		time_total = time_out - time_in;
+		getuptime(&time_out);
+		secs = time_out.sec - time_in.sec;
+		if(time_out.usec < time_in.usec) {
+			secs--;
+			time_out.usec += 1000000;
+		}
+		usecs = time_out.usec - time_in.usec;
 		printf(1, "\n");
 		printf(1, "%s ", name);
-		printf(1,"ran in %d.%d%d seconds \n", time_total/100, time_total % 100 / 10, time_total%10);
+		printf(1,"ran in %d.%d%d%d%d%d%d seconds \n", secs, usecs/100000, usecs/10000%10, usecs/1000%10, usecs/100%10, usecs/10%10, usecs%10);
 	}
 
 	return 0;
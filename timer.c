@@ -6,6 +6,7 @@
 #include "defs.h"
 #include "traps.h"
 #include "x86.h"
+#include "date.h"
 
 #define IO_TIMER1       0x040           // 8253 Timer #1
 
@@ -18,6 +19,8 @@
 
 #define TIMER_MODE      (IO_TIMER1 + 3) // timer mode port
 #define TIMER_SEL0      0x00    // select counter 0
+#define TIMER_SEL2      0x80    // select counter 2
+#define TIMER_ONESHOT   0x00    // mode 0, interrupt on terminal count
 #define TIMER_RATEGEN   0x04    // mode 2, rate generator
 #define TIMER_16BIT     0x30    // r/w counter 16 bits, LSB first
 
@@ -30,3 +33,67 @@ timerinit(void)
   outb(IO_TIMER1, TIMER_DIV(100) / 256);
   picenable(IRQ_TIMER);
 }
+
+#define IO_TIMER2       (IO_TIMER1 + 2) // counter 2 data port
+#define IO_PORTB        0x61            // counter 2 gate and output
+#define CALIBRATE_MS    10              // how long tscinit() watches the PIT
+
+uint tscperus = 1;      // TSC cycles per microsecond
+static uint64 tscboot;  // TSC when tscinit() ran
+
+// Measure the TSC against a CALIBRATE_MS countdown on PIT counter 2,
+// which is free on both uniprocessors and SMP machines.
+void
+tscinit(void)
+{
+  uint64 t0, t1;
+  uint count = TIMER_DIV(1000 / CALIBRATE_MS);
+
+  // Gate counter 2 on with the speaker off, then load it.
+  outb(IO_PORTB, (inb(IO_PORTB) & ~0x02) | 0x01);
+  outb(TIMER_MODE, TIMER_SEL2 | TIMER_ONESHOT | TIMER_16BIT);
+  outb(IO_TIMER2, count % 256);
+  outb(IO_TIMER2, count / 256);
+
+  t0 = rdtsc();
+  while((inb(IO_PORTB) & 0x20) == 0)  // OUT2 goes high at zero
+    ;
+  t1 = rdtsc();
+
+  tscperus = (uint)(t1 - t0) / (CALIBRATE_MS * 1000);
+  if(tscperus == 0)
+    tscperus = 1;
+  tscboot = t1;
+  cprintf("tsc: %d cycles/us\n", tscperus);
+}
+
+// Convert a TSC cycle count to microseconds.
+uint64
+tsc2us(uint64 cycles)
+{
+  return divu64(cycles, tscperus, 0);
+}
+
+// Convert microseconds to a TSC cycle count.
+uint64
+us2tsc(uint us)
+{
+  return (uint64)us * tscperus;
+}
+
+// Fill in *tv with the time since boot at which the TSC read tsc.
+void
+tsctime(uint64 tsc, struct timeval *tv)
+{
+  uint usec;
+
+  tv->sec = divu64(tsc2us(tsc - tscboot), 1000000, &usec);
+  tv->usec = usec;
+}
+
+// Fill in *tv with the time since boot, to the microsecond.
+void
+uptimeus(struct timeval *tv)
+{
+  tsctime(rdtsc(), tv);
+}
@@ -0,0 +1,93 @@
+// Drain the scheduler trace and print it in time order.
+//   trace            print whatever has been recorded since the last drain
+//   trace cmd args   throw away the backlog, run cmd, then print its trace
+
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "trace.h"
+
+#define MAXEV (NCPU * NTRACE)
+
+static char *names[] = {
+[TR_DISPATCH] "dispatch",
+[TR_YIELD]    "yield",
+[TR_SLEEP]    "sleep",
+[TR_WAKEUP]   "wakeup",
+[TR_DEMOTE]   "demote",
+[TR_BOOST]    "boost",
+[TR_FORK]     "fork",
+[TR_EXIT]     "exit",
+[TR_LOST]     "lost",
+[TR_HANDOFF]  "handoff",
+[TR_INHERIT]  "inherit",
+};
+
+static int
+before(struct traceevent *a, struct traceevent *b)
+{
+  return a->sec < b->sec || (a->sec == b->sec && a->usec < b->usec);
+}
+
+// Each cpu's events come back in order, so the array is a few sorted
+// runs and an insertion sort does little work.
+static void
+sort(struct traceevent *ev, int n)
+{
+  struct traceevent t;
+  int i, j;
+
+  for(i = 1; i < n; i++){
+    t = ev[i];
+    for(j = i; j > 0 && before(&t, &ev[j-1]); j--)
+      ev[j] = ev[j-1];
+    ev[j] = t;
+  }
+}
+
+static void
+print(struct traceevent *e)
+{
+  uint u = e->usec;
+
+  printf(1, "%d.%d%d%d%d%d%d\t%d\t%d\t%d\t%s\t", e->sec, u/100000, u/10000%10,
+    u/1000%10, u/100%10, u/10%10, u%10, e->cpu, e->pid, e->prio, names[e->type]);
+  if(e->type == TR_SLEEP || e->type == TR_WAKEUP)
+    printf(1, "%x\n", e->arg);
+  else
+    printf(1, "%d\n", e->arg);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct traceevent *ev;
+  int i, n, got;
+
+  ev = malloc(MAXEV * sizeof(*ev));
+  if(ev == 0){
+    printf(2, "trace: out of memory\n");
+    exit();
+  }
+
+  if(argc > 1){
+    while(schedtrace(ev, MAXEV) > 0)
+      ;
+    if(fork() == 0){
+      exec(argv[1], &argv[1]);
+      printf(2, "trace: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+  }
+
+  n = 0;
+  while(n < MAXEV && (got = schedtrace(ev + n, MAXEV - n)) > 0)
+    n += got;
+
+  sort(ev, n);
+  printf(1, "time\t\tcpu\tpid\tprio\tevent\targ\n");
+  for(i = 0; i < n; i++)
+    print(&ev[i]);
+  exit();
+}
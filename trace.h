@@ -0,0 +1,23 @@
+// Scheduler trace events, as handed out by schedtrace().
+#define TR_DISPATCH 1   // arg: cpu whose queue it came from
+#define TR_YIELD    2
+#define TR_SLEEP    3   // arg: sleep channel
+#define TR_WAKEUP   4   // arg: sleep channel
+#define TR_DEMOTE   5   // arg: new priority
+#define TR_BOOST    6   // arg: new priority
+#define TR_FORK     7   // arg: parent pid
+#define TR_EXIT     8
+#define TR_LOST     9   // arg: events overwritten before they were drained
+#define TR_HANDOFF  10  // arg: pid giving up its cpu to this one
+#define TR_INHERIT  11  // arg: priority lent by a waiter on a lock it holds
+
+struct traceevent {
+  uint sec;             // Time since boot
+  uint usec;
+  uint pid;
+  uint arg;
+  uchar cpu;
+  uchar type;
+  uchar prio;           // Priority it was ranked by then, boosts and loans included
+  uchar pad;
+};
@@ -3,10 +3,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -38,11 +38,14 @@ trap(struct trapframe *tf)
 {
   if(tf->trapno == T_SYSCALL){
     if(proc->killed)
-      exit();
+      exit(-1);
     proc->tf = tf;
     syscall();
     if(proc->killed)
-      exit();
+      exit(-1);
+    // The call woke a process that outranks us here; let it run now.
+    if(cpu->needresched)
+      yield();
     return;
   }
 
@@ -52,6 +55,16 @@ trap(struct trapframe *tf)
       atom_inc((int *)&ticks);   // guaranteed atomic so no lock necessary
       wakeup(&ticks);
     }
+    // An idle CPU's one-shot deadline came due: restart its tick
+    // and make scheduler() take the lock for another look.
+    if(lapicperiodic())
+      cpu->idle = 0;
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_RESCHED:
+    // Another CPU queued work for us while we were idle, or work
+    // that outranks our process. Returning is all it takes: to
+    // scheduler() when idle, else through the yield below.
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -96,14 +109,16 @@ trap(struct trapframe *tf)
   // (If it is still executing in the kernel, let it keep running 
   // until it gets to the regular system call return.)
   if(proc && proc->killed && (tf->cs&3) == DPL_USER)
-    exit();
+    exit(-1);
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU once its time slice is over, or on
+  // any trap once a process that outranks it is queued here.
   // If interrupts were on while locks held, would need to check nlock.
-  if(proc && proc->state == RUNNING && tf->trapno == T_IRQ0+IRQ_TIMER)
+  if(proc && proc->state == RUNNING &&
+     ((tf->trapno == T_IRQ0+IRQ_TIMER && sliceover()) || cpu->needresched))
     yield();
 
   // Check if the process has been killed since we yielded
   if(proc && proc->killed && (tf->cs&3) == DPL_USER)
-    exit();
+    exit(-1);
 }
@@ -7,8 +7,60 @@ struct uproc {
 	uint ppid;
 	uint prio;
 	uint elapsed_ticks;
-	uint CPU_total_ticks;
+	uint CPU_total_secs;
+	uint CPU_total_usecs;
 	char state[STRMAX];
 	uint size;
+	uint affinity;
 	char name[STRMAX];
-};
\ No newline at end of file
+};
+
+// procsnap() state values, in enum procstate order.
+#define PS_UNUSED   0
+#define PS_EMBRYO   1
+#define PS_SLEEPING 2
+#define PS_RUNNABLE 3
+#define PS_RUNNING  4
+#define PS_ZOMBIE   5
+
+// Compact per-process record from procsnap().
+struct procsnap {
+	uint pid;
+	uint ppid;
+	uint uid;
+	uint gid;
+	uint state;
+	uint prio;
+	uint tickets;
+	uint pass;        // Stride pass over STRIDE1: microseconds run per ticket
+	uint cpu;
+	uint affinity;
+	uint size;
+	uint elapsed_ticks;
+	uint CPU_total_secs;
+	uint CPU_total_usecs;
+	char name[16];
+};
+
+// MLFQ tunables and counters from mlfqstat(). Needs param.h for MAX.
+struct mlfqlevel {
+	uint quantum;     // Ticks in a time slice at this priority
+	uint budget;      // Ticks run at this priority before demotion
+	uint dispatches;  // Runs at this priority, summed over cpus
+	uint demotions;   // Runs that ended in a demotion
+	uint runms;       // Milliseconds run at this priority
+};
+
+// Contention on the process table's locks from lockstat(). Locks
+// there are many of, one per proc, cpu or sleep bucket, are summed.
+struct lockstat {
+	char name[16];
+	uint spins;       // Acquires that found the lock held
+	uint spinus;      // Microseconds spent spinning for it
+};
+
+struct mlfqstat {
+	uint boost;       // Ticks between priority boosts
+	uint switches;    // Dispatches under any policy, summed over cpus
+	struct mlfqlevel level[MAX];
+};
@@ -1,6 +1,11 @@
 struct stat;
 struct rtcdate;
+struct timeval;
+struct traceevent;
 struct uproc;
+struct procsnap;
+struct mlfqstat;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -40,6 +45,22 @@ int chmod(char *pathname, int mode);
 int chown(char *pathname, int owner);
 int chgrp(char *pathname, int group);	
 #endif
+int getuptime(struct timeval*);
+int setaffinity(int pid, uint mask);
+int getaffinity(int pid);
+int isolcpus(uint mask);
+int schedtrace(struct traceevent*, int max);
+int procsnap(int *cursor, struct procsnap*, int max);
+int setrealtime(int pid, uint period, uint runtime);
+int yield_to(int pid);
+int waitpid(int pid, int *status, int options);
+int exitstatus(int status) __attribute__((noreturn));
+int settickets(int pid, int tickets);
+int setpolicy(int policy);
+int setboost(int ticks);
+int setquantum(int prio, int quantum, int budget);
+int mlfqstat(struct mlfqstat*);
+int lockstat(struct lockstat*, int);
 
 // ulib.c
 int stat(char*, struct stat*);
@@ -7,6 +7,7 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "wait.h"
 
 char buf[8192];
 char name[3];
@@ -424,6 +425,65 @@ exitwait(void)
   printf(1, "exitwait ok\n");
 }
 
+// waitpid() with WNOHANG, exit statuses, waiting for a process that
+// isn't a child, and the status of a child killed in the kernel.
+void
+exitstatustest(void)
+{
+  int pid, st, fds[2];
+  char c;
+
+  printf(1, "exitstatus test\n");
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    read(fds[0], &c, 1);
+    exitstatus(3);
+  }
+  st = 99;
+  if(waitpid(pid, &st, WNOHANG) != 0 || st != 99){
+    printf(1, "waitpid WNOHANG didn't return 0 for a running child\n");
+    exit();
+  }
+  write(fds[1], "x", 1);
+  if(waitpid(pid, &st, 0) != pid || st != 3){
+    printf(1, "waitpid got status %d, not 3\n", st);
+    exit();
+  }
+  if(waitpid(pid, &st, 0) != -1 || waitpid(getpid(), &st, WNOHANG) != -1){
+    printf(1, "waitpid found a process that isn't our child\n");
+    exit();
+  }
+
+  // Blocked in read() on the still-open pipe, so the kill lands in
+  // the kernel.
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    read(fds[0], &c, 1);
+    exitstatus(0);
+  }
+  sleep(1);
+  kill(pid);
+  if(waitpid(pid, &st, 0) != pid || st != -1){
+    printf(1, "killed child has status %d, not -1\n", st);
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  printf(1, "exitstatus ok\n");
+}
+
 void
 mem(void)
 {
@@ -1740,6 +1800,7 @@ main(int argc, char *argv[])
   pipe1();
   preempt();
   exitwait();
+  exitstatustest();
 
   rmdot();
   fourteen();
@@ -4,6 +4,7 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "elf.h"
 
@@ -124,9 +125,9 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
-pde_t*
-setupkvm(void)
+// Set up kernel part of a new page table.
+static pde_t*
+newkvm(void)
 {
   pde_t *pgdir;
   struct kmap *k;
@@ -143,12 +144,33 @@ setupkvm(void)
   return pgdir;
 }
 
+// Return a page table with the kernel part mapped and nothing
+// below KERNBASE. Reuse one that freevm() kept on this CPU if
+// there is one: mapping the kernel part takes dozens of pages.
+pde_t*
+setupkvm(void)
+{
+  pde_t *pgdir = 0;
+
+  pushcli();
+  if(cpu->npgdirs > 0){
+    pgdir = cpu->pgdirs[--cpu->npgdirs];
+    cpu->pgdirhit++;
+  } else
+    cpu->pgdirmiss++;
+  popcli();
+  if(pgdir == 0)
+    pgdir = newkvm();
+  return pgdir;
+}
+
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes. Runs before cpu is set up, so it
+// can't use the per-CPU cache.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  kpgdir = newkvm();
   switchkvm();
 }
 
@@ -273,7 +295,8 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part. The kernel part stays mapped if the
+// table goes on this CPU's cache for setupkvm().
 void
 freevm(pde_t *pgdir)
 {
@@ -282,7 +305,24 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if(pgdir[i] & PTE_P){
+      char * v = p2v(PTE_ADDR(pgdir[i]));
+      kfree(v);
+      pgdir[i] = 0;
+    }
+  }
+
+  pushcli();
+  if(cpu->npgdirs < NPGDIRCACHE){
+    cpu->pgdirs[cpu->npgdirs++] = pgdir;
+    pgdir = 0;
+  }
+  popcli();
+  if(pgdir == 0)
+    return;
+
+  for(i = PDX(KERNBASE); i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
       char * v = p2v(PTE_ADDR(pgdir[i]));
       kfree(v);
@@ -0,0 +1 @@
+#define WNOHANG   0x001  // waitpid: return 0 rather than block if no child has exited
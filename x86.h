@@ -15,6 +15,15 @@ hlt()
   asm volatile("hlt");
 }
 
+// Enable interrupts and halt until the next one. sti takes effect
+// after the next instruction, so nothing can slip in between and
+// leave us halted with work to do.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
 static inline void
 lock_inc(uint* mem)
 {
@@ -33,6 +42,41 @@ lock_add(uint* mem, uint n)
   asm volatile("lock add %0, %1" : "=m" (mem) : "d" (n));
 }
 
+// Read the cycle counter.
+static inline uint64
+rdtsc(void)
+{
+  uint64 t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
+// 64-by-32 bit unsigned divide, without libgcc.  Stores the
+// remainder in *rem if rem is non-zero.
+static inline uint64
+divu64(uint64 n, uint d, uint *rem)
+{
+  uint hi, lo, r;
+
+  hi = (uint)(n >> 32) / d;
+  r = (uint)(n >> 32) % d;
+  asm("divl %4" : "=a" (lo), "=d" (r) : "a" ((uint)n), "d" (r), "rm" (d));
+  if(rem)
+    *rem = r;
+  return ((uint64)hi << 32) | lo;
+}
+
+// Index of the lowest set bit; word must be non-zero.
+static inline uint
+bsf(uint word)
+{
+  uint idx;
+
+  asm volatile("bsf %1, %0" : "=r" (idx) : "rm" (word));
+  return idx;
+}
+
 // end of CS333 added routines
 
 static inline uchar